@@ -0,0 +1,35 @@
+#include <iostream>
+#include <string>
+#include "Utils.hpp"
+#include "Serialize.hpp"
+#include "CodeGen.hpp"
+
+// FFNNCodegen <model file> <output header> [namespace]
+// reads a model in either file format and writes a standalone inference header for it
+int main(int argc, char* argv[]) {
+    if (argc < 3 || argc > 4) {
+        std::cerr << "Usage: FFNNCodegen <model file> <output header> [namespace]" << std::endl;
+        return 2;
+    }
+
+    try {
+        std::string modelPath = argv[1];
+        std::string outputPath = argv[2];
+        std::string name = argc == 4 ? std::string(argv[3]) : codegen::identifierFromPath(outputPath);
+        if (!codegen::isNamespaceName(name)) {
+            std::cerr << "Error: namespace \"" << name << "\" must be identifiers ([A-Za-z_][A-Za-z0-9_]*) separated by ::" << std::endl;
+            return 2;
+        }
+
+        std::vector<Layer> layers = readModel(modelPath);
+        generateInferenceHeader(layers, outputPath, name, modelPath);
+
+        std::cout << "Wrote " << outputPath << " (namespace " << name << ", " << layers.size() << " layers)" << std::endl;
+    }
+    catch (const std::exception& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -51,4 +51,46 @@ Matrix reluPrime(const Matrix& z) {
     }
 
     return result;
-}
\ No newline at end of file
+}
+
+// Softmax over a column vector, shifted by its largest value so exp never overflows
+Matrix softmax(const Matrix& input) {
+    Matrix result(input.numRows(), input.numCols());
+    double maxValue = input[0][0];
+    for (size_t i = 1; i < input.numRows(); i++) {
+        maxValue = std::max(maxValue, input[i][0]);
+    }
+
+    double sum = 0.0;
+    for (size_t i = 0; i < input.numRows(); i++) {
+        result[i][0] = std::exp(input[i][0] - maxValue);
+        sum += result[i][0];
+    }
+    for (size_t i = 0; i < input.numRows(); i++) {
+        result[i][0] /= sum;
+    }
+
+    return result;
+}
+
+// apply the activation selected for a layer
+Matrix activate(const Matrix& z, Activations activation) {
+    switch (activation) {
+    case Activations::relu:
+        return relu(z);
+    case Activations::sigmoid:
+    default:
+        return sigmoid(z);
+    }
+}
+
+// derivative of the activation selected for a layer
+Matrix activatePrime(const Matrix& z, Activations activation) {
+    switch (activation) {
+    case Activations::relu:
+        return reluPrime(z);
+    case Activations::sigmoid:
+    default:
+        return sigmoidPrime(z);
+    }
+}
@@ -0,0 +1,226 @@
+#pragma once
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include "Matrix.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+struct AugmentConfig {
+	double maxShift = 2.0; // pixels, per axis
+	double maxRotation = 10.0; // degrees
+	double minScale = 0.9;
+	double maxScale = 1.1;
+	double elasticAlpha = 34.0; // scale of the smoothed displacement field, 0 disables the elastic distortion
+	double elasticSigma = 4.0; // smoothness of the displacement field
+	uint64_t seed = 0;
+};
+
+// splitmix64 finalizer, spreads (seed, epoch, index) into an independent rng seed
+inline uint64_t mixSeed(uint64_t x) {
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+// Random affine (shift, rotation, scale) plus elastic distortion (Simard et al. 2003) of single images.
+// Every draw is seeded from (seed, epoch, index), so the same sample gets the same distortion in a
+// rerun no matter which worker thread picks it up. apply() is const and safe to call concurrently.
+class Augmenter {
+public:
+	explicit Augmenter(const AugmentConfig& config = AugmentConfig()) : config(config) {}
+
+	void apply(Matrix& image, uint64_t epoch, uint64_t index) const {
+		const size_t rows = image.numRows();
+		const size_t cols = image.numCols();
+		if (rows < 2 || cols < 2) {
+			return;
+		}
+
+		std::mt19937_64 gen(mixSeed(mixSeed(mixSeed(config.seed) ^ epoch) ^ index));
+		std::uniform_real_distribution<double> unit(-1.0, 1.0);
+
+		// inverse affine map: for every output pixel find where it comes from in the source
+		const double pi = 3.14159265358979323846;
+		double angle = unit(gen) * config.maxRotation * pi / 180.0;
+		double scale = config.minScale + (unit(gen) * 0.5 + 0.5) * (config.maxScale - config.minScale);
+		double shiftX = unit(gen) * config.maxShift;
+		double shiftY = unit(gen) * config.maxShift;
+		double c = std::cos(angle) / scale;
+		double s = std::sin(angle) / scale;
+		double centerX = (cols - 1) / 2.0;
+		double centerY = (rows - 1) / 2.0;
+
+		Scratch& scratch = scratchBuffers();
+		scratch.srcX.resize(rows * cols);
+		scratch.srcY.resize(rows * cols);
+		for (size_t y = 0; y < rows; y++) {
+			for (size_t x = 0; x < cols; x++) {
+				double dx = x - centerX - shiftX;
+				double dy = y - centerY - shiftY;
+				scratch.srcX[y * cols + x] = static_cast<float>(centerX + c * dx + s * dy);
+				scratch.srcY[y * cols + x] = static_cast<float>(centerY - s * dx + c * dy);
+			}
+		}
+
+		if (config.elasticAlpha > 0.0) {
+			addElasticField(scratch, rows, cols, gen);
+		}
+
+		// copy the source into a zero-padded contiguous buffer so the sampler never needs bounds checks
+		const size_t stride = cols + 3;
+		scratch.padded.assign((rows + 3) * stride, 0.0f);
+		for (size_t y = 0; y < rows; y++) {
+			for (size_t x = 0; x < cols; x++) {
+				scratch.padded[(y + 1) * stride + (x + 1)] = static_cast<float>(image[y][x]);
+			}
+		}
+
+		scratch.out.resize(rows * cols);
+		bilinearSample(scratch, rows, cols);
+
+		for (size_t y = 0; y < rows; y++) {
+			for (size_t x = 0; x < cols; x++) {
+				image[y][x] = scratch.out[y * cols + x];
+			}
+		}
+	}
+
+	const AugmentConfig& getConfig() const noexcept {
+		return config;
+	}
+
+private:
+	AugmentConfig config;
+
+	struct Scratch {
+		std::vector<float> srcX;
+		std::vector<float> srcY;
+		std::vector<float> fieldX;
+		std::vector<float> fieldY;
+		std::vector<float> blurTmp;
+		std::vector<float> kernel;
+		std::vector<float> padded;
+		std::vector<float> out;
+	};
+
+	// per worker thread, so apply() allocates nothing after the first image
+	static Scratch& scratchBuffers() {
+		thread_local Scratch scratch;
+		return scratch;
+	}
+
+	void addElasticField(Scratch& scratch, size_t rows, size_t cols, std::mt19937_64& gen) const {
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		scratch.fieldX.resize(rows * cols);
+		scratch.fieldY.resize(rows * cols);
+		for (size_t i = 0; i < rows * cols; i++) {
+			scratch.fieldX[i] = unit(gen);
+			scratch.fieldY[i] = unit(gen);
+		}
+
+		// normalized gaussian kernel, radius 3 sigma
+		int radius = std::max(1, static_cast<int>(std::ceil(3.0 * config.elasticSigma)));
+		scratch.kernel.resize(2 * radius + 1);
+		float sum = 0.0f;
+		for (int k = -radius; k <= radius; k++) {
+			float w = static_cast<float>(std::exp(-(k * k) / (2.0 * config.elasticSigma * config.elasticSigma)));
+			scratch.kernel[k + radius] = w;
+			sum += w;
+		}
+		for (auto& w : scratch.kernel) {
+			w /= sum;
+		}
+
+		blur(scratch, scratch.fieldX, rows, cols, radius);
+		blur(scratch, scratch.fieldY, rows, cols, radius);
+
+		const float alpha = static_cast<float>(config.elasticAlpha);
+		for (size_t i = 0; i < rows * cols; i++) {
+			scratch.srcX[i] += alpha * scratch.fieldX[i];
+			scratch.srcY[i] += alpha * scratch.fieldY[i];
+		}
+	}
+
+	// separable gaussian blur with clamped edges
+	static void blur(Scratch& scratch, std::vector<float>& field, size_t rows, size_t cols, int radius) {
+		const std::vector<float>& kernel = scratch.kernel;
+
+		scratch.blurTmp.resize(rows * cols);
+		for (size_t y = 0; y < rows; y++) {
+			for (size_t x = 0; x < cols; x++) {
+				float acc = 0.0f;
+				for (int k = -radius; k <= radius; k++) {
+					long xx = std::min<long>(std::max<long>(static_cast<long>(x) + k, 0), static_cast<long>(cols) - 1);
+					acc += kernel[k + radius] * field[y * cols + xx];
+				}
+				scratch.blurTmp[y * cols + x] = acc;
+			}
+		}
+		for (size_t y = 0; y < rows; y++) {
+			for (size_t x = 0; x < cols; x++) {
+				float acc = 0.0f;
+				for (int k = -radius; k <= radius; k++) {
+					long yy = std::min<long>(std::max<long>(static_cast<long>(y) + k, 0), static_cast<long>(rows) - 1);
+					acc += kernel[k + radius] * scratch.blurTmp[yy * cols + x];
+				}
+				field[y * cols + x] = acc;
+			}
+		}
+	}
+
+	// samples scratch.padded at (srcX, srcY) into scratch.out, 8 pixels at a time with AVX2 gathers
+	static void bilinearSample(Scratch& scratch, size_t rows, size_t cols) {
+		const size_t n = rows * cols;
+		const int stride = static_cast<int>(cols + 3);
+		const float maxX = static_cast<float>(cols);
+		const float maxY = static_cast<float>(rows);
+		const float* src = scratch.padded.data();
+		size_t i = 0;
+
+#ifdef __AVX2__
+		const __m256 lo = _mm256_set1_ps(-1.0f);
+		const __m256 hiX = _mm256_set1_ps(maxX);
+		const __m256 hiY = _mm256_set1_ps(maxY);
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256i strideVec = _mm256_set1_epi32(stride);
+		const __m256i originVec = _mm256_set1_epi32(stride + 1); // padded index of pixel (0, 0)
+		for (; i + 8 <= n; i += 8) {
+			__m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(&scratch.srcX[i]), lo), hiX);
+			__m256 y = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(&scratch.srcY[i]), lo), hiY);
+			__m256 x0 = _mm256_floor_ps(x);
+			__m256 y0 = _mm256_floor_ps(y);
+			__m256 fx = _mm256_sub_ps(x, x0);
+			__m256 fy = _mm256_sub_ps(y, y0);
+
+			__m256i idx = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvtps_epi32(y0), strideVec), _mm256_cvtps_epi32(x0)), originVec);
+			__m256 p00 = _mm256_i32gather_ps(src, idx, 4);
+			__m256 p01 = _mm256_i32gather_ps(src + 1, idx, 4);
+			__m256 p10 = _mm256_i32gather_ps(src + stride, idx, 4);
+			__m256 p11 = _mm256_i32gather_ps(src + stride + 1, idx, 4);
+
+			__m256 top = _mm256_add_ps(_mm256_mul_ps(p00, _mm256_sub_ps(one, fx)), _mm256_mul_ps(p01, fx));
+			__m256 bottom = _mm256_add_ps(_mm256_mul_ps(p10, _mm256_sub_ps(one, fx)), _mm256_mul_ps(p11, fx));
+			_mm256_storeu_ps(&scratch.out[i], _mm256_add_ps(_mm256_mul_ps(top, _mm256_sub_ps(one, fy)), _mm256_mul_ps(bottom, fy)));
+		}
+#endif
+
+		for (; i < n; i++) {
+			float x = std::min(std::max(scratch.srcX[i], -1.0f), maxX);
+			float y = std::min(std::max(scratch.srcY[i], -1.0f), maxY);
+			float x0 = std::floor(x);
+			float y0 = std::floor(y);
+			float fx = x - x0;
+			float fy = y - y0;
+
+			const float* p = src + (static_cast<int>(y0) + 1) * stride + (static_cast<int>(x0) + 1);
+			float top = p[0] * (1.0f - fx) + p[1] * fx;
+			float bottom = p[stride] * (1.0f - fx) + p[stride + 1] * fx;
+			scratch.out[i] = top * (1.0f - fy) + bottom * fy;
+		}
+	}
+};
@@ -0,0 +1,270 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <latch>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+#include "Idx.hpp"
+#include "Inflate.hpp"
+#include "InferenceSession.hpp"
+#include "ThreadPool.hpp"
+#include "TopK.hpp"
+
+// Samples read sequentially from an IDX file (any element type, uint8 scaled to [0, 1] like
+// MNISTLoader) or from a raw file of back-to-back uint8 records of numInputs bytes each. Either may
+// be gzip-compressed.
+class SampleReader {
+public:
+	SampleReader(const std::string& filename, bool raw, size_t numInputs) : numInputs(numInputs) {
+		if (raw) {
+			stream = openByteStream(filename);
+			return;
+		}
+		idx = std::make_unique<IdxReader>(filename);
+		if (idx->header().dims.size() < 2 || idx->header().itemSize() != numInputs) {
+			throw std::runtime_error(filename + " holds items of " + std::to_string(idx->header().itemSize()) + " values, the model takes " + std::to_string(numInputs));
+		}
+		scale = idx->header().type == IdxType::uint8 ? 1.0f / 255.0f : 1.0f;
+	}
+
+	// reads up to count samples into dst (count * numInputs floats), returns how many were read
+	size_t read(float* dst, size_t count) {
+		if (idx) {
+			count = idx->readItems(dst, count);
+			if (scale != 1.0f) {
+				for (size_t i = 0; i < count * numInputs; i++) {
+					dst[i] *= scale;
+				}
+			}
+			return count;
+		}
+
+		bytes.resize(count * numInputs);
+		size_t total = 0;
+		for (size_t got = 1; total < bytes.size() && got > 0; total += got) {
+			got = stream->read(reinterpret_cast<char*>(bytes.data()) + total, bytes.size() - total);
+		}
+		if (total % numInputs != 0) {
+			throw std::runtime_error("Raw input ends in the middle of a record of " + std::to_string(numInputs) + " bytes.");
+		}
+		for (size_t i = 0; i < total; i++) {
+			dst[i] = bytes[i] / 255.0f;
+		}
+		return total / numInputs;
+	}
+
+private:
+	std::unique_ptr<IdxReader> idx;
+	std::unique_ptr<ByteStream> stream;
+	size_t numInputs;
+	float scale = 1.0f;
+	std::vector<uint8_t> bytes;
+};
+
+// Labels read sequentially from a 1-dimensional integer IDX file, or from a raw file of one byte per label.
+class LabelReader {
+public:
+	LabelReader(const std::string& filename, bool raw) {
+		if (raw) {
+			stream = openByteStream(filename);
+			return;
+		}
+		idx = std::make_unique<IdxReader>(filename);
+		if (idx->header().dims.size() != 1 || idx->header().type == IdxType::float32 || idx->header().type == IdxType::float64) {
+			throw std::runtime_error("Label file must be a 1-dimensional integer IDX file.");
+		}
+	}
+
+	// reads up to count labels, returns how many were read
+	size_t read(int* dst, size_t count) {
+		if (idx) {
+			return idx->readItems(dst, count);
+		}
+		bytes.resize(count);
+		size_t total = 0;
+		for (size_t got = 1; total < count && got > 0; total += got) {
+			got = stream->read(reinterpret_cast<char*>(bytes.data()) + total, count - total);
+		}
+		std::copy(bytes.begin(), bytes.begin() + total, dst);
+		return total;
+	}
+
+private:
+	std::unique_ptr<IdxReader> idx;
+	std::unique_ptr<ByteStream> stream;
+	std::vector<uint8_t> bytes;
+};
+
+enum class PredictionFormat {
+	none,
+	csv, // header row, then index,prediction,p0..pN-1[,label] per sample
+	binary // "FFNP", Uint32 numOutputs, then per sample Int32 prediction and numOutputs float32 probabilities, little-endian
+};
+
+struct PredictionSummary {
+	size_t samples = 0;
+	size_t labelled = 0;
+	size_t correct = 0;
+	double seconds = 0.0; // first read to last write
+
+	double imagesPerSecond() const noexcept {
+		return seconds > 0.0 ? samples / seconds : 0.0;
+	}
+
+	double accuracy() const noexcept {
+		return labelled > 0 ? 100.0 * correct / labelled : 0.0;
+	}
+};
+
+// Streams a sample file through a compiled model in chunks of chunkSize samples. Each chunk is split
+// across the pool, one InferenceSession per thread running whole tiles, while the calling thread
+// reads the next chunk; the finished chunk is then written in input order. Memory stays at two
+// chunks however large the file is.
+class BatchPredictor {
+public:
+	BatchPredictor(std::shared_ptr<const CompiledModel> model, size_t threads, size_t chunkSize = 4096) :
+		model(std::move(model)), chunkSize(std::max<size_t>(chunkSize, 1)), pool(threads)
+	{
+		for (size_t t = 0; t < threads; t++) {
+			sessions.emplace_back(this->model);
+		}
+	}
+
+	// labels may be null; output may be null when format is none
+	PredictionSummary run(SampleReader& samples, LabelReader* labels, std::ostream* output, PredictionFormat format) {
+		const size_t numInputs = model->numInputs();
+		const size_t numOutputs = model->numOutputs();
+		Chunk current, next;
+		for (Chunk* chunk : { &current, &next }) {
+			chunk->inputs.resize(chunkSize * numInputs);
+			chunk->outputs.resize(chunkSize * numOutputs);
+			chunk->labels.resize(chunkSize);
+		}
+		writeHeader(output, format, numOutputs);
+
+		PredictionSummary summary;
+		auto start = std::chrono::steady_clock::now();
+		readChunk(samples, labels, current);
+		while (current.count > 0) {
+			std::latch done(sessions.size());
+			const size_t perThread = (current.count + sessions.size() - 1) / sessions.size();
+			for (size_t t = 0; t < sessions.size(); t++) {
+				pool.submit([&, t] {
+					const size_t first = std::min(current.count, t * perThread);
+					const size_t count = std::min(current.count - first, perThread);
+					sessions[t].runBatch(std::span<const float>(current.inputs.data() + first * numInputs, count * numInputs),
+						std::span<float>(current.outputs.data() + first * numOutputs, count * numOutputs), count);
+					done.count_down();
+				});
+			}
+			// the pool reads current until done, so a failed read waits for it before unwinding
+			try {
+				readChunk(samples, labels, next);
+			}
+			catch (...) {
+				done.wait();
+				throw;
+			}
+			done.wait();
+
+			writeChunk(current, summary, output, format);
+			std::swap(current, next);
+		}
+		if (output) {
+			output->flush();
+		}
+		summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return summary;
+	}
+
+private:
+	struct Chunk {
+		std::vector<float> inputs;
+		std::vector<float> outputs;
+		std::vector<int> labels;
+		size_t count = 0;
+		size_t labelled = 0;
+	};
+
+	std::shared_ptr<const CompiledModel> model;
+	size_t chunkSize;
+	std::vector<InferenceSession> sessions;
+	std::vector<int> predictions; // writeChunk scratch
+	std::vector<float> probabilities;
+	std::string line;
+	ThreadPool pool; // last, so its threads are joined before the sessions they use go away
+
+	void readChunk(SampleReader& samples, LabelReader* labels, Chunk& chunk) {
+		chunk.count = samples.read(chunk.inputs.data(), chunkSize);
+		chunk.labelled = labels ? labels->read(chunk.labels.data(), chunk.count) : 0;
+		if (labels && chunk.labelled != chunk.count) {
+			throw std::runtime_error("Label file has fewer labels than there are samples.");
+		}
+	}
+
+	static void writeHeader(std::ostream* output, PredictionFormat format, size_t numOutputs) {
+		if (!output || format == PredictionFormat::none) {
+			return;
+		}
+		if (format == PredictionFormat::binary) {
+			const uint32_t outputs = static_cast<uint32_t>(numOutputs);
+			output->write("FFNP", 4);
+			output->write(reinterpret_cast<const char*>(&outputs), sizeof(outputs));
+			return;
+		}
+		*output << "index,prediction";
+		for (size_t i = 0; i < numOutputs; i++) {
+			*output << ",p" << i;
+		}
+		*output << ",label\n";
+	}
+
+	// probabilities are the outputs over their sum, as the server reports them
+	void writeChunk(const Chunk& chunk, PredictionSummary& summary, std::ostream* output, PredictionFormat format) {
+		const size_t numOutputs = model->numOutputs();
+		predictions.resize(chunk.count);
+		argmaxBatch(chunk.outputs.data(), numOutputs, chunk.count, predictions.data());
+		for (size_t s = 0; s < chunk.count; s++) {
+			const int prediction = predictions[s];
+			if (s < chunk.labelled) {
+				summary.labelled++;
+				summary.correct += prediction == chunk.labels[s];
+			}
+
+			if (!output || format == PredictionFormat::none) {
+				continue;
+			}
+			const float* outputs = chunk.outputs.data() + s * numOutputs;
+			const float scale = topk::probabilityScale(outputs, numOutputs);
+			probabilities.resize(numOutputs);
+			for (size_t i = 0; i < numOutputs; i++) {
+				probabilities[i] = outputs[i] * scale;
+			}
+			if (format == PredictionFormat::binary) {
+				const int32_t label = prediction;
+				output->write(reinterpret_cast<const char*>(&label), sizeof(label));
+				output->write(reinterpret_cast<const char*>(probabilities.data()), numOutputs * sizeof(float));
+				continue;
+			}
+			line = std::to_string(summary.samples + s) + ',' + std::to_string(prediction);
+			for (float p : probabilities) {
+				char value[32];
+				std::snprintf(value, sizeof(value), ",%.6g", p);
+				line += value;
+			}
+			line += ',';
+			if (s < chunk.labelled) {
+				line += std::to_string(chunk.labels[s]);
+			}
+			line += '\n';
+			output->write(line.data(), line.size());
+		}
+		summary.samples += chunk.count;
+	}
+};
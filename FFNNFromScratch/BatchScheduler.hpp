@@ -0,0 +1,175 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+// what the batch scheduler currently does and how recent requests fared
+struct BatchingMetrics {
+	size_t batchLimit; // largest batch a worker takes now
+	std::chrono::microseconds window; // how long a worker holds the oldest request for the batch to fill
+	double meanBatch; // requests per batch since the last adjustment
+	double meanQueueDelayMicros; // enqueue -> batch taken by a worker, since the last adjustment
+	double p99Micros; // enqueue -> outputs computed, over the last adjustment period
+	uint64_t requests; // totals since construction
+	uint64_t batches;
+};
+
+// Chooses the batch limit and wait window for a DynamicBatcher. With a latency target of 0 both stay
+// at the configured maximums. Otherwise the scheduler keeps a running compute time per batch size
+// and adjusts both online so the p99 enqueue-to-result latency meets the target while batches stay
+// as large as possible:
+//   - the limit never exceeds the largest size whose compute time fits twice into the target
+//     (a request can wait for one running batch and then run in its own)
+//   - over target with full batches, there is a backlog and bigger batches drain it faster
+//   - over target with partial batches, the window is what costs latency, so it is halved
+//   - well under target, the limit grows if batches are filling up, and the window hill-climbs on
+//     throughput: it keeps growing only while that raises throughput and otherwise shrinks, since
+//     waiting that coalesces nothing extra only adds latency
+class BatchScheduler {
+public:
+	BatchScheduler(size_t maxBatch, std::chrono::microseconds maxWait, std::chrono::microseconds latencyTarget) :
+		maxBatch(maxBatch), maxWait(maxWait), target(static_cast<double>(latencyTarget.count())),
+		computeMicros(maxBatch + 1, 0.0), lastAdjust(std::chrono::steady_clock::now())
+	{
+		if (target > 0.0) {
+			limit = std::max<size_t>(1, maxBatch / 4);
+			windowMicros = std::min<int64_t>(maxWait.count(), latencyTarget.count() / 4);
+		}
+		else {
+			limit = maxBatch;
+			windowMicros = maxWait.count();
+		}
+	}
+
+	size_t batchLimit() const noexcept {
+		return limit.load(std::memory_order_relaxed);
+	}
+
+	std::chrono::microseconds window() const noexcept {
+		return std::chrono::microseconds(windowMicros.load(std::memory_order_relaxed));
+	}
+
+	// one computed batch: its compute time and, per request, the queueing delay and total latency
+	void record(double batchMicros, std::span<const double> queueDelays, std::span<const double> latencies) {
+		std::lock_guard<std::mutex> lock(mutex);
+		const size_t size = latencies.size();
+		double& estimate = computeMicros[std::min(size, maxBatch)];
+		estimate = estimate == 0.0 ? batchMicros : 0.9 * estimate + 0.1 * batchMicros;
+
+		totalRequests += size;
+		totalBatches++;
+		periodBatches++;
+		for (double delay : queueDelays) {
+			periodQueueDelay += delay;
+		}
+		periodLatencies.insert(periodLatencies.end(), latencies.begin(), latencies.end());
+
+		// a period ends after enough requests for a meaningful p99, or after a while at low load
+		const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - lastAdjust).count();
+		if (periodLatencies.size() >= 200 || (elapsed >= 0.1 && periodLatencies.size() >= 20)) {
+			endPeriod();
+		}
+	}
+
+	BatchingMetrics metrics() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return { batchLimit(), window(), lastMeanBatch, lastQueueDelay, lastP99, totalRequests, totalBatches };
+	}
+
+private:
+	const size_t maxBatch;
+	const std::chrono::microseconds maxWait;
+	const double target; // microseconds, 0 = fixed limits
+
+	std::atomic<size_t> limit;
+	std::atomic<int64_t> windowMicros;
+
+	mutable std::mutex mutex;
+	std::vector<double> computeMicros; // running compute time per batch size, 0 = not seen yet
+	std::vector<double> periodLatencies;
+	double periodQueueDelay = 0.0;
+	uint64_t periodBatches = 0;
+	std::chrono::steady_clock::time_point lastAdjust;
+	uint64_t totalRequests = 0;
+	uint64_t totalBatches = 0;
+	double lastMeanBatch = 0.0;
+	double lastQueueDelay = 0.0;
+	double lastP99 = 0.0;
+	double lastThroughput = 0.0; // requests per second over the previous period
+	bool windowGrowing = false;
+
+	// sizes not seen yet are scaled from the nearest smaller one, or taken from the nearest larger one
+	double estimateCompute(size_t size) const {
+		if (computeMicros[size] > 0.0) {
+			return computeMicros[size];
+		}
+		for (size_t s = size; s-- > 1;) {
+			if (computeMicros[s] > 0.0) {
+				return computeMicros[s] * size / s;
+			}
+		}
+		for (size_t s = size + 1; s <= maxBatch; s++) {
+			if (computeMicros[s] > 0.0) {
+				return computeMicros[s];
+			}
+		}
+		return 0.0;
+	}
+
+	void endPeriod() {
+		const size_t count = periodLatencies.size();
+		auto p99 = periodLatencies.begin() + std::min(count - 1, count * 99 / 100);
+		std::nth_element(periodLatencies.begin(), p99, periodLatencies.end());
+		lastP99 = *p99;
+		lastMeanBatch = static_cast<double>(count) / periodBatches;
+		lastQueueDelay = periodQueueDelay / count;
+		if (target > 0.0) {
+			adjust(count / std::max(1e-6, std::chrono::duration<double>(std::chrono::steady_clock::now() - lastAdjust).count()));
+		}
+
+		periodLatencies.clear();
+		periodQueueDelay = 0.0;
+		periodBatches = 0;
+		lastAdjust = std::chrono::steady_clock::now();
+	}
+
+	void adjust(double throughput) {
+		size_t cap = 1;
+		while (cap < maxBatch && 2.0 * estimateCompute(cap + 1) <= target) {
+			cap++;
+		}
+
+		size_t newLimit = std::min(limit.load(), cap);
+		double newWindow = static_cast<double>(windowMicros.load());
+		const bool full = lastMeanBatch >= 0.9 * newLimit;
+		if (lastP99 > target) {
+			if (full) {
+				newLimit = std::min(cap, newLimit + std::max<size_t>(1, newLimit / 4));
+			}
+			else {
+				newWindow /= 2.0;
+			}
+		}
+		else if (lastP99 < 0.8 * target) {
+			if (full) {
+				newLimit = std::min(cap, newLimit + std::max<size_t>(1, newLimit / 4));
+			}
+			const bool paid = throughput > 1.05 * lastThroughput;
+			const bool lost = throughput < 0.95 * lastThroughput;
+			windowGrowing = windowGrowing ? paid : lost;
+			newWindow = windowGrowing ? std::max(newWindow * 1.25, newWindow + 10.0) : newWindow * 0.8;
+		}
+		lastThroughput = throughput;
+
+		// the window never takes the budget the batch itself needs
+		const double budget = std::max(0.0, target - 2.0 * estimateCompute(newLimit));
+		newWindow = std::min({ newWindow, budget, static_cast<double>(maxWait.count()) });
+
+		limit = newLimit;
+		windowMicros = static_cast<int64_t>(newWindow);
+	}
+};
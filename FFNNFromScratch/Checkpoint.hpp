@@ -0,0 +1,167 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include "Layer.hpp"
+#include "Serialize.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+// moves source over target in one step, readers see either the old or the new file, never a partial one
+inline void replaceFile(const std::string& source, const std::string& target) {
+#ifdef _WIN32
+	bool ok = MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool ok = std::rename(source.c_str(), target.c_str()) == 0;
+#endif
+	if (!ok) {
+		throw std::runtime_error("Unable to move " + source + " to " + target);
+	}
+}
+
+// Periodic training checkpoints written off the training thread.
+// snapshot() only copies the weights into a staging buffer and returns; a writer thread saves the
+// staged copy to path + ".tmp" and renames it over path. If training produces snapshots faster than
+// they can be written, the newest one replaces the staged one that hasn't been written yet.
+class Checkpointer {
+public:
+	// a checkpoint is due every everySteps mini-batches or everySeconds seconds, 0 disables either trigger
+	Checkpointer(const std::string& path, size_t everySteps, double everySeconds) :
+		path(path), everySteps(everySteps), everySeconds(everySeconds), lastTime(std::chrono::steady_clock::now())
+	{
+		writer = std::thread([this] { writeLoop(); });
+	}
+
+	~Checkpointer() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		writer.join(); // a staged snapshot is still written before the thread exits
+	}
+
+	Checkpointer(const Checkpointer&) = delete;
+	Checkpointer& operator=(const Checkpointer&) = delete;
+
+	bool due(uint64_t step) const {
+		if (everySteps > 0 && step - lastStep >= everySteps) {
+			return true;
+		}
+		return everySeconds > 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - lastTime).count() >= everySeconds;
+	}
+
+	// copies the parameters into the staging buffer and hands them to the writer
+	void snapshot(const std::vector<Layer>& layers, const TrainingState& state) {
+		std::unique_lock<std::mutex> lock(mutex);
+		rethrowWriteError();
+
+		// same shapes every time, so after the first snapshot this only copies values
+		if (staged.size() != layers.size()) {
+			staged.clear();
+			for (const auto& layer : layers) {
+				staged.emplace_back(layer.weights, layer.biases, layer.activation);
+			}
+		}
+		else {
+			for (size_t l = 0; l < layers.size(); l++) {
+				staged[l].weights = layers[l].weights;
+				staged[l].biases = layers[l].biases;
+				staged[l].activation = layers[l].activation;
+			}
+		}
+		stagedState = state;
+		hasStaged = true;
+		lastStep = state.step;
+		lastTime = std::chrono::steady_clock::now();
+
+		lock.unlock();
+		wake.notify_all();
+	}
+
+	// blocks until every snapshot taken so far is on disk
+	void flush() {
+		std::unique_lock<std::mutex> lock(mutex);
+		idle.wait(lock, [this] { return !hasStaged && !writing; });
+		rethrowWriteError();
+	}
+
+	const std::string& getPath() const noexcept {
+		return path;
+	}
+
+private:
+	std::string path;
+	size_t everySteps;
+	double everySeconds;
+	uint64_t lastStep = 0;
+	std::chrono::steady_clock::time_point lastTime;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::vector<Layer> staged; // filled by snapshot()
+	std::vector<Layer> writeBuffer; // owned by the writer while it saves
+	TrainingState stagedState = TrainingState();
+	bool hasStaged = false;
+	bool writing = false;
+	bool stopping = false;
+	std::exception_ptr writeError;
+	std::thread writer;
+
+	void rethrowWriteError() {
+		if (writeError) {
+			std::exception_ptr error = writeError;
+			writeError = nullptr;
+			std::rethrow_exception(error);
+		}
+	}
+
+	void writeLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			wake.wait(lock, [this] { return hasStaged || stopping; });
+			if (!hasStaged) {
+				return;
+			}
+
+			// swap buffers so the trainer can stage the next snapshot while this one is written
+			staged.swap(writeBuffer);
+			TrainingState state = stagedState;
+			hasStaged = false;
+			writing = true;
+			lock.unlock();
+
+			std::exception_ptr error;
+			try {
+				const std::string temp = path + ".tmp";
+				saveModel(writeBuffer, temp, ModelSaveOptions(), state);
+				replaceFile(temp, path);
+			}
+			catch (...) {
+				error = std::current_exception();
+			}
+
+			lock.lock();
+			if (error) {
+				writeError = error;
+			}
+			writing = false;
+			idle.notify_all();
+		}
+	}
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// CRC-32 (IEEE 802.3), used by the gzip trailer and the dataset/model file headers
+// slicing-by-8: eight table lookups per 8 input bytes instead of one per byte
+inline uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+	static const std::vector<uint32_t> table = [] {
+		std::vector<uint32_t> t(8 * 256);
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++) {
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : (c >> 1);
+			}
+			t[i] = c;
+		}
+		for (uint32_t i = 0; i < 256; i++) {
+			for (int s = 1; s < 8; s++) {
+				t[s * 256 + i] = t[t[(s - 1) * 256 + i] & 0xFF] ^ (t[(s - 1) * 256 + i] >> 8);
+			}
+		}
+		return t;
+	}();
+	const uint32_t* t = table.data();
+
+	crc = ~crc;
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		// bytes are combined explicitly, so this is independent of host byte order and alignment
+		uint32_t lo = crc ^ (uint32_t(data[i]) | uint32_t(data[i + 1]) << 8 | uint32_t(data[i + 2]) << 16 | uint32_t(data[i + 3]) << 24);
+		crc = t[7 * 256 + (lo & 0xFF)] ^ t[6 * 256 + ((lo >> 8) & 0xFF)] ^ t[5 * 256 + ((lo >> 16) & 0xFF)] ^ t[4 * 256 + (lo >> 24)]
+			^ t[3 * 256 + data[i + 4]] ^ t[2 * 256 + data[i + 5]] ^ t[256 + data[i + 6]] ^ t[data[i + 7]];
+	}
+	for (; i < len; i++) {
+		crc = t[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+// XXH64, a 64-bit non-cryptographic hash at several bytes per cycle, for in-memory lookup keys.
+// Words are read in host byte order, so the value is only stable on one kind of machine and is
+// never written to files (CRC-32 above covers those).
+inline uint64_t xxHash64(const uint8_t* data, size_t len, uint64_t seed = 0) {
+	constexpr uint64_t p1 = 0x9E3779B185EBCA87ull, p2 = 0xC2B2AE3D27D4EB4Full, p3 = 0x165667B19E3779F9ull;
+	constexpr uint64_t p4 = 0x85EBCA77C2B2AE63ull, p5 = 0x27D4EB2F165667C5ull;
+	auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+	auto read64 = [](const uint8_t* p) { uint64_t v; std::memcpy(&v, p, 8); return v; };
+	auto read32 = [](const uint8_t* p) { uint32_t v; std::memcpy(&v, p, 4); return v; };
+	auto round = [&](uint64_t acc, uint64_t input) { return rotl(acc + input * p2, 31) * p1; };
+	auto merge = [&](uint64_t acc, uint64_t lane) { return (acc ^ round(0, lane)) * p1 + p4; };
+
+	const uint8_t* p = data;
+	const uint8_t* end = data + len;
+	uint64_t h;
+	if (len >= 32) {
+		// four independent lanes over 32-byte stripes
+		uint64_t v1 = seed + p1 + p2, v2 = seed + p2, v3 = seed, v4 = seed - p1;
+		for (; p + 32 <= end; p += 32) {
+			v1 = round(v1, read64(p));
+			v2 = round(v2, read64(p + 8));
+			v3 = round(v3, read64(p + 16));
+			v4 = round(v4, read64(p + 24));
+		}
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+	}
+	else {
+		h = seed + p5;
+	}
+	h += len;
+
+	for (; p + 8 <= end; p += 8) {
+		h = rotl(h ^ round(0, read64(p)), 27) * p1 + p4;
+	}
+	if (p + 4 <= end) {
+		h = rotl(h ^ (read32(p) * p1), 23) * p2 + p3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h = rotl(h ^ (*p * p5), 11) * p1;
+	}
+
+	h ^= h >> 33;
+	h *= p2;
+	h ^= h >> 29;
+	h *= p3;
+	h ^= h >> 32;
+	return h;
+}
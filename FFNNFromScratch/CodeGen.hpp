@@ -0,0 +1,217 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cmath>
+#include <cstdio>
+#include <cctype>
+#include <stdexcept>
+#include "Layer.hpp"
+
+// Ahead-of-time code generation: turns a trained network into one self-contained header with the
+// weights as aligned constexpr float arrays and a predict(const float*, float*) specialized for the
+// exact layer sizes. The generated code includes only standard headers (and immintrin.h when built
+// with AVX2), so it needs neither Matrix, Layer nor SFML to compile.
+
+namespace codegen {
+
+	// shortest decimal that reads back as the same float, always with a '.' or exponent so the 'f' suffix is valid
+	inline std::string floatLiteral(double value) {
+		float f = static_cast<float>(value);
+		if (!std::isfinite(f)) {
+			throw std::runtime_error("Cannot generate code for a non-finite weight.");
+		}
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%.9g", f);
+		std::string literal = buffer;
+		if (literal.find_first_of(".e") == std::string::npos) {
+			literal += ".0";
+		}
+		return literal + "f";
+	}
+
+	// emits name[count] = { ... }, eight values per line
+	inline void writeArray(std::ofstream& out, const std::string& name, const double* values, size_t count) {
+		out << "\talignas(32) inline constexpr float " << name << "[" << count << "] = {";
+		for (size_t i = 0; i < count; i++) {
+			out << (i % 8 == 0 ? "\n\t\t" : " ") << floatLiteral(values[i]) << (i + 1 < count ? "," : "");
+		}
+		out << "\n\t};\n\n";
+	}
+
+	// the kernel every generated header carries: out = activation(W * in + b) with Rows and Cols as
+	// constants, four rows per pass under AVX2 and eight partial sums per row otherwise
+	inline const char* denseKernel() {
+		return R"(	namespace detail {
+		enum class Activation { sigmoid, relu };
+
+		inline float activate(float z, Activation activation) {
+			return activation == Activation::relu ? (z > 0.0f ? z : 0.0f) : 1.0f / (1.0f + std::exp(-z));
+		}
+
+		template <std::size_t Rows, std::size_t Cols, Activation A>
+		inline void dense(const float* w, const float* b, const float* in, float* out) {
+			constexpr std::size_t body = Cols - Cols % 8;
+#ifdef __AVX2__
+			constexpr std::size_t blocked = Rows - Rows % 4;
+			for (std::size_t r = 0; r < blocked; r += 4) {
+				const float* w0 = w + r * Cols;
+				__m256 acc0 = _mm256_setzero_ps(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+				for (std::size_t k = 0; k < body; k += 8) {
+					__m256 x = _mm256_loadu_ps(in + k);
+					acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(x, _mm256_loadu_ps(w0 + k)));
+					acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(x, _mm256_loadu_ps(w0 + Cols + k)));
+					acc2 = _mm256_add_ps(acc2, _mm256_mul_ps(x, _mm256_loadu_ps(w0 + 2 * Cols + k)));
+					acc3 = _mm256_add_ps(acc3, _mm256_mul_ps(x, _mm256_loadu_ps(w0 + 3 * Cols + k)));
+				}
+				alignas(32) float sums[4][8];
+				_mm256_store_ps(sums[0], acc0);
+				_mm256_store_ps(sums[1], acc1);
+				_mm256_store_ps(sums[2], acc2);
+				_mm256_store_ps(sums[3], acc3);
+				for (std::size_t i = 0; i < 4; i++) {
+					float z = ((sums[i][0] + sums[i][1]) + (sums[i][2] + sums[i][3])) + ((sums[i][4] + sums[i][5]) + (sums[i][6] + sums[i][7]));
+					for (std::size_t k = body; k < Cols; k++) {
+						z += w0[i * Cols + k] * in[k];
+					}
+					out[r + i] = activate(z + b[r + i], A);
+				}
+			}
+#else
+			constexpr std::size_t blocked = 0;
+#endif
+			if constexpr (blocked < Rows) {
+				for (std::size_t r = blocked; r < Rows; r++) {
+					const float* row = w + r * Cols;
+					float acc[8] = {};
+					for (std::size_t k = 0; k < body; k += 8) {
+						for (std::size_t j = 0; j < 8; j++) {
+							acc[j] += row[k + j] * in[k + j];
+						}
+					}
+					float z = ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+					for (std::size_t k = body; k < Cols; k++) {
+						z += row[k] * in[k];
+					}
+					out[r] = activate(z + b[r], A);
+				}
+			}
+		}
+	}
+
+)";
+	}
+
+	// turns e.g. "Models/ffnn_model.hpp" into "ffnn_model", usable as a namespace
+	inline std::string identifierFromPath(const std::string& path) {
+		size_t start = path.find_last_of("/\\");
+		start = start == std::string::npos ? 0 : start + 1;
+		size_t end = path.find('.', start);
+		std::string name = path.substr(start, end == std::string::npos ? std::string::npos : end - start);
+		for (char& c : name) {
+			if (!std::isalnum(static_cast<unsigned char>(c))) {
+				c = '_';
+			}
+		}
+		if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))) {
+			name = "model_" + name;
+		}
+		return name;
+	}
+
+	// [A-Za-z_][A-Za-z0-9_]* segments joined by "::", e.g. "models::mnist"
+	inline bool isNamespaceName(const std::string& name) {
+		size_t start = 0;
+		while (true) {
+			size_t end = name.find("::", start);
+			std::string segment = name.substr(start, end == std::string::npos ? std::string::npos : end - start);
+			if (segment.empty() || std::isdigit(static_cast<unsigned char>(segment[0]))) {
+				return false;
+			}
+			for (char c : segment) {
+				if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') {
+					return false;
+				}
+			}
+			if (end == std::string::npos) {
+				return true;
+			}
+			start = end + 2;
+		}
+	}
+
+}
+
+// Writes the generated header to outputPath. Everything lands in namespace name:
+// numInputs, numOutputs, the layerN weight and bias arrays, predict(input, output) and classify(input).
+inline void generateInferenceHeader(const std::vector<Layer>& layers, const std::string& outputPath, const std::string& name, const std::string& source = "") {
+	if (layers.empty()) {
+		throw std::invalid_argument("Cannot generate code for a network without layers.");
+	}
+	if (!codegen::isNamespaceName(name)) {
+		throw std::invalid_argument("\"" + name + "\" is not a valid C++ namespace name.");
+	}
+	for (size_t l = 1; l < layers.size(); l++) {
+		if (layers[l].weights.numCols() != layers[l - 1].weights.numRows()) {
+			throw std::invalid_argument("Layer " + std::to_string(l) + " input size does not match the previous layer.");
+		}
+	}
+
+	std::ofstream out(outputPath, std::ios::binary);
+	if (!out.is_open()) {
+		throw std::runtime_error("Unable to open file for writing: " + outputPath);
+	}
+
+	out << "#pragma once\n";
+	out << "// Generated by FFNNCodegen" << (source.empty() ? "" : " from " + source) << ", do not edit.\n";
+	out << "// Topology:";
+	out << " " << layers.front().weights.numCols();
+	for (const auto& layer : layers) {
+		out << " -> " << layer.weights.numRows();
+	}
+	out << "\n#include <cstddef>\n#include <cmath>\n\n#ifdef __AVX2__\n#include <immintrin.h>\n#endif\n\n";
+	out << "namespace " << name << " {\n\n";
+	out << "\tinline constexpr std::size_t numInputs = " << layers.front().weights.numCols() << ";\n";
+	out << "\tinline constexpr std::size_t numOutputs = " << layers.back().weights.numRows() << ";\n\n";
+
+	for (size_t l = 0; l < layers.size(); l++) {
+		const Layer& layer = layers[l];
+		codegen::writeArray(out, "layer" + std::to_string(l) + "Weights", layer.weights.data(), layer.weights.numRows() * layer.weights.numCols());
+		codegen::writeArray(out, "layer" + std::to_string(l) + "Biases", layer.biases.data(), layer.biases.numRows());
+	}
+
+	out << codegen::denseKernel();
+
+	out << "\t// numInputs values in, numOutputs values out\n";
+	out << "\tinline void predict(const float* input, float* output) {\n";
+	for (size_t l = 0; l + 1 < layers.size(); l++) {
+		out << "\t\talignas(32) float hidden" << l << "[" << layers[l].weights.numRows() << "];\n";
+	}
+	for (size_t l = 0; l < layers.size(); l++) {
+		const Layer& layer = layers[l];
+		std::string in = l == 0 ? "input" : "hidden" + std::to_string(l - 1);
+		std::string result = l + 1 == layers.size() ? "output" : "hidden" + std::to_string(l);
+		std::string activation = layer.activation == Activations::relu ? "relu" : "sigmoid";
+		out << "\t\tdetail::dense<" << layer.weights.numRows() << ", " << layer.weights.numCols() << ", detail::Activation::" << activation << ">("
+			<< "layer" << l << "Weights, layer" << l << "Biases, " << in << ", " << result << ");\n";
+	}
+	out << "\t}\n\n";
+
+	out << "\t// index of the largest output\n";
+	out << "\tinline int classify(const float* input) {\n";
+	out << "\t\tfloat output[numOutputs];\n";
+	out << "\t\tpredict(input, output);\n";
+	out << "\t\tint best = 0;\n";
+	out << "\t\tfor (std::size_t i = 1; i < numOutputs; i++) {\n";
+	out << "\t\t\tif (output[i] > output[best]) {\n";
+	out << "\t\t\t\tbest = static_cast<int>(i);\n";
+	out << "\t\t\t}\n";
+	out << "\t\t}\n";
+	out << "\t\treturn best;\n";
+	out << "\t}\n\n";
+	out << "}\n";
+
+	if (!out) {
+		throw std::runtime_error("Error writing generated code to " + outputPath);
+	}
+}
@@ -0,0 +1,323 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <queue>
+#include <functional>
+#include "Inflate.hpp"
+
+// Lightweight compression for tensor blobs: a byte shuffle that groups the i-th byte of every element
+// together (exponent and high mantissa bytes of nearby weights are alike, so they form runs), followed
+// by either an LZ77 coder in the LZ4 sequence layout or an order-0 huffman coder per byte plane.
+
+// [e0b0 e0b1 .. e1b0 e1b1 ..] -> [e0b0 e1b0 .. e0b1 e1b1 ..]
+inline void byteShuffle(const uint8_t* src, uint8_t* dst, size_t count, size_t elementSize) {
+	for (size_t b = 0; b < elementSize; b++) {
+		uint8_t* plane = dst + b * count;
+		for (size_t i = 0; i < count; i++) {
+			plane[i] = src[i * elementSize + b];
+		}
+	}
+}
+
+inline void byteUnshuffle(const uint8_t* src, uint8_t* dst, size_t count, size_t elementSize) {
+	for (size_t b = 0; b < elementSize; b++) {
+		const uint8_t* plane = src + b * count;
+		for (size_t i = 0; i < count; i++) {
+			dst[i * elementSize + b] = plane[i];
+		}
+	}
+}
+
+namespace lz {
+	const size_t minMatch = 4;
+	const size_t maxOffset = 65535;
+	const int hashBits = 16;
+
+	inline uint32_t read32(const uint8_t* p) {
+		uint32_t v;
+		std::memcpy(&v, p, 4);
+		return v;
+	}
+
+	inline uint32_t hash(uint32_t v) {
+		return (v * 2654435761u) >> (32 - hashBits);
+	}
+
+	// lengths above 14 (15 for literals) continue in bytes of 255 plus a final remainder byte
+	inline void putLength(std::vector<uint8_t>& out, size_t length) {
+		while (length >= 255) {
+			out.push_back(255);
+			length -= 255;
+		}
+		out.push_back(static_cast<uint8_t>(length));
+	}
+}
+
+// Each sequence is a token (literal count in the high nibble, match length - 4 in the low nibble),
+// the literals, a 16-bit little-endian match offset and the match. The last sequence has literals only.
+inline std::vector<uint8_t> lzCompress(const uint8_t* src, size_t size) {
+	std::vector<uint8_t> out;
+	out.reserve(size / 2 + 16);
+	std::vector<int64_t> table(size_t(1) << lz::hashBits, -1); // last position seen for each hash
+
+	size_t anchor = 0; // start of pending literals
+	size_t pos = 0;
+	auto emit = [&](size_t literalEnd, size_t matchLength, size_t offset) {
+		size_t literals = literalEnd - anchor;
+		size_t matchCode = matchLength ? matchLength - lz::minMatch : 0;
+		out.push_back(static_cast<uint8_t>((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(matchCode, 15)));
+		if (literals >= 15) {
+			lz::putLength(out, literals - 15);
+		}
+		out.insert(out.end(), src + anchor, src + literalEnd);
+		if (matchLength) {
+			out.push_back(static_cast<uint8_t>(offset & 0xFF));
+			out.push_back(static_cast<uint8_t>(offset >> 8));
+			if (matchCode >= 15) {
+				lz::putLength(out, matchCode - 15);
+			}
+		}
+	};
+
+	while (size >= lz::minMatch && pos + lz::minMatch <= size) {
+		uint32_t h = lz::hash(lz::read32(src + pos));
+		int64_t candidate = table[h];
+		table[h] = static_cast<int64_t>(pos);
+
+		if (candidate >= 0 && pos - candidate <= lz::maxOffset && lz::read32(src + candidate) == lz::read32(src + pos)) {
+			size_t length = lz::minMatch;
+			while (pos + length < size && src[candidate + length] == src[pos + length]) {
+				length++;
+			}
+			emit(pos, length, pos - candidate);
+			pos += length;
+			anchor = pos;
+		}
+		else {
+			pos++;
+		}
+	}
+	emit(size, 0, 0);
+	return out;
+}
+
+// decodes into exactly outSize bytes, throws on malformed input instead of reading or writing out of bounds
+inline void lzDecompress(const uint8_t* src, size_t size, uint8_t* out, size_t outSize) {
+	const uint8_t* end = src + size;
+	size_t written = 0;
+	auto getLength = [&](size_t length) {
+		if (length == 15) {
+			uint8_t b;
+			do {
+				if (src >= end) {
+					throw std::runtime_error("Corrupt compressed block");
+				}
+				b = *src++;
+				length += b;
+			} while (b == 255);
+		}
+		return length;
+	};
+
+	while (src < end) {
+		uint8_t token = *src++;
+		size_t literals = getLength(token >> 4);
+		if (literals > static_cast<size_t>(end - src) || literals > outSize - written) {
+			throw std::runtime_error("Corrupt compressed block");
+		}
+		std::memcpy(out + written, src, literals);
+		src += literals;
+		written += literals;
+		if (src == end) {
+			break; // final, literal-only sequence
+		}
+
+		if (end - src < 2) {
+			throw std::runtime_error("Corrupt compressed block");
+		}
+		size_t offset = src[0] | (size_t(src[1]) << 8);
+		src += 2;
+		size_t length = getLength(token & 0x0F) + lz::minMatch;
+		if (offset == 0 || offset > written || length > outSize - written) {
+			throw std::runtime_error("Corrupt compressed block");
+		}
+
+		// byte by byte, matches may overlap the bytes they produce
+		const uint8_t* from = out + written - offset;
+		for (size_t i = 0; i < length; i++) {
+			out[written + i] = from[i];
+		}
+		written += length;
+	}
+
+	if (written != outSize) {
+		throw std::runtime_error("Corrupt compressed block");
+	}
+}
+
+// Huffman coded byte stream: 128 bytes of 4-bit code lengths (symbol 2i in the low nibble), the bit
+// stream size as a little-endian uint32, then the codes packed LSB first as in deflate, so decoding can
+// reuse HuffmanTable. Appends to out, the symbol count is known to the decoder.
+inline void huffmanCompress(const uint8_t* src, size_t size, std::vector<uint8_t>& out) {
+	std::vector<uint64_t> freq(256, 0);
+	for (size_t i = 0; i < size; i++) {
+		freq[src[i]]++;
+	}
+
+	// plain huffman code lengths, halving the counts until the longest code fits in maxBits
+	uint8_t lengths[256] = {};
+	for (;;) {
+		typedef std::pair<uint64_t, int> Node; // weight, node id
+		std::priority_queue<Node, std::vector<Node>, std::greater<Node>> heap;
+		std::vector<int> parent(512, -1);
+		int nextId = 256;
+		for (int s = 0; s < 256; s++) {
+			if (freq[s] > 0) {
+				heap.push(Node(freq[s], s));
+			}
+		}
+		if (heap.size() == 1) {
+			lengths[heap.top().second] = 1;
+			break;
+		}
+		while (heap.size() > 1) {
+			Node a = heap.top();
+			heap.pop();
+			Node b = heap.top();
+			heap.pop();
+			parent[a.second] = parent[b.second] = nextId;
+			heap.push(Node(a.first + b.first, nextId++));
+		}
+
+		int longest = 0;
+		for (int s = 0; s < 256; s++) {
+			int depth = 0;
+			for (int n = s; freq[s] > 0 && parent[n] >= 0; n = parent[n]) {
+				depth++;
+			}
+			lengths[s] = static_cast<uint8_t>(depth);
+			longest = std::max(longest, depth);
+		}
+		if (longest <= HuffmanTable::maxBits) {
+			break;
+		}
+		for (auto& f : freq) {
+			f = f ? (f + 1) / 2 : 0;
+		}
+	}
+
+	for (int s = 0; s < 256; s += 2) {
+		out.push_back(static_cast<uint8_t>(lengths[s] | (lengths[s + 1] << 4)));
+	}
+
+	// canonical codes, bit reversed so they can be emitted LSB first
+	uint32_t codes[256] = {};
+	uint32_t code = 0;
+	for (int len = 1; len <= HuffmanTable::maxBits; len++) {
+		for (int s = 0; s < 256; s++) {
+			if (lengths[s] == len) {
+				uint32_t reversed = 0;
+				for (int b = 0; b < len; b++) {
+					reversed |= ((code >> b) & 1u) << (len - 1 - b);
+				}
+				codes[s] = reversed;
+				code++;
+			}
+		}
+		code <<= 1;
+	}
+
+	size_t sizePos = out.size();
+	out.resize(out.size() + 4);
+	size_t start = out.size();
+	uint64_t bitBuf = 0;
+	int bitCount = 0;
+	for (size_t i = 0; i < size; i++) {
+		bitBuf |= uint64_t(codes[src[i]]) << bitCount;
+		bitCount += lengths[src[i]];
+		while (bitCount >= 8) {
+			out.push_back(static_cast<uint8_t>(bitBuf));
+			bitBuf >>= 8;
+			bitCount -= 8;
+		}
+	}
+	if (bitCount > 0) {
+		out.push_back(static_cast<uint8_t>(bitBuf));
+	}
+
+	uint32_t streamBytes = static_cast<uint32_t>(out.size() - start);
+	for (int b = 0; b < 4; b++) {
+		out[sizePos + b] = static_cast<uint8_t>(streamBytes >> (8 * b));
+	}
+}
+
+// decodes outSize symbols, returns how many input bytes the stream used
+inline size_t huffmanDecompress(const uint8_t* src, size_t size, uint8_t* out, size_t outSize) {
+	if (size < 132) {
+		throw std::runtime_error("Corrupt compressed block");
+	}
+	uint8_t lengths[256];
+	for (int s = 0; s < 256; s += 2) {
+		lengths[s] = src[s / 2] & 0x0F;
+		lengths[s + 1] = src[s / 2] >> 4;
+	}
+	uint32_t streamBytes = src[128] | (uint32_t(src[129]) << 8) | (uint32_t(src[130]) << 16) | (uint32_t(src[131]) << 24);
+	if (streamBytes > size - 132) {
+		throw std::runtime_error("Corrupt compressed block");
+	}
+	if (outSize == 0) {
+		return 132 + streamBytes;
+	}
+
+	HuffmanTable table;
+	table.build(lengths, 256);
+
+	const uint8_t* in = src + 132;
+	const uint8_t* end = in + streamBytes;
+	uint64_t bitBuf = 0;
+	int bitCount = 0;
+	uint64_t consumedBits = 0;
+	for (size_t i = 0; i < outSize; i++) {
+		// past the end of the stream the buffer is padded with zero bits, running out is caught below
+		while (bitCount <= 56) {
+			bitBuf |= uint64_t(in < end ? *in++ : 0) << bitCount;
+			bitCount += 8;
+		}
+
+		uint16_t entry = table.fast[bitBuf & ((1u << HuffmanTable::fastBits) - 1)];
+		int len = entry & 0xF;
+		int symbol = entry >> 4;
+		if (entry == 0) {
+			// long code, walk the canonical counts
+			int code = 0, first = 0, index = 0;
+			symbol = -1;
+			for (len = 1; len <= HuffmanTable::maxBits; len++) {
+				code |= static_cast<int>((bitBuf >> (len - 1)) & 1);
+				int count = table.counts[len];
+				if (code - first < count) {
+					symbol = table.symbols[index + (code - first)];
+					break;
+				}
+				index += count;
+				first = (first + count) << 1;
+				code <<= 1;
+			}
+			if (symbol < 0) {
+				throw std::runtime_error("Corrupt compressed block");
+			}
+		}
+		bitBuf >>= len;
+		bitCount -= len;
+		consumedBits += len;
+		out[i] = static_cast<uint8_t>(symbol);
+	}
+
+	// every consumed bit must have come from the stream
+	if (consumedBits > uint64_t(streamBytes) * 8) {
+		throw std::runtime_error("Corrupt compressed block");
+	}
+	return 132 + streamBytes;
+}
@@ -0,0 +1,187 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <chrono>
+#include "Matrix.hpp"
+
+// one mini-batch slot, allocated once and refilled in place by the prefetch workers
+struct MiniBatch {
+	std::vector<Matrix> data;
+	std::vector<int> targets;
+	size_t index = 0; // position of the batch within the epoch
+};
+
+// random-access source of training samples
+class Dataset {
+public:
+	virtual ~Dataset() = default;
+
+	virtual size_t size() const = 0;
+
+	// writes sample index into out, normalized and ready for the network
+	// must be safe to call from several threads at once
+	virtual void getSample(size_t index, Matrix& out) const = 0;
+
+	virtual int getLabel(size_t index) const = 0;
+
+	// true while the set is still loading front to back (getSample blocks past the loaded prefix),
+	// so a first epoch starting now should not jump to the end of the set
+	virtual bool loadsInOrder() const {
+		return false;
+	}
+};
+
+// adapter for the in-memory image/label vectors FFNN::train has always taken
+class MatrixDataset : public Dataset {
+public:
+	MatrixDataset(const std::vector<Matrix>& images, const std::vector<int>& labels) : images(images), labels(labels) {}
+
+	size_t size() const override {
+		return images.size();
+	}
+
+	void getSample(size_t index, Matrix& out) const override {
+		out = images[index]; // copy-assign reuses the slot's storage once it has the right shape
+	}
+
+	int getLabel(size_t index) const override {
+		return labels[index];
+	}
+
+private:
+	const std::vector<Matrix>& images;
+	const std::vector<int>& labels;
+};
+
+// Fills the next `depth` mini-batches of an epoch on worker threads while the training thread
+// consumes the current one. Batch b always lands in slot b % depth, so batches come out in order
+// no matter which worker produced them. Time the consumer spends blocked is reported as stall time.
+class BatchPrefetcher {
+public:
+	using FillFn = std::function<void(size_t batchIndex, MiniBatch& batch)>;
+
+	BatchPrefetcher(size_t numBatches, size_t depth, size_t numWorkers, FillFn fill) :
+		numBatches(numBatches), fill(std::move(fill)), slots(std::max<size_t>(depth, 1))
+	{
+		for (size_t i = 0; i < std::max<size_t>(numWorkers, 1); i++) {
+			workers.emplace_back(&BatchPrefetcher::workerLoop, this);
+		}
+	}
+
+	~BatchPrefetcher() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		slotFree.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	BatchPrefetcher(const BatchPrefetcher&) = delete;
+	BatchPrefetcher& operator=(const BatchPrefetcher&) = delete;
+
+	// returns the next batch of the epoch, or nullptr once every batch has been handed out
+	// the returned batch stays valid until the following call
+	const MiniBatch* next() {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		// hand the previously consumed slot back to the workers
+		if (nextToConsume > 0) {
+			slots[(nextToConsume - 1) % slots.size()].state = SlotState::free;
+			slotFree.notify_all();
+		}
+
+		if (nextToConsume == numBatches) {
+			return nullptr;
+		}
+
+		Slot& slot = slots[nextToConsume % slots.size()];
+		auto ready = [&] { return error || (slot.state == SlotState::ready && slot.batch.index == nextToConsume); };
+		if (!ready()) {
+			auto start = std::chrono::steady_clock::now();
+			slotReady.wait(lock, ready);
+			stallTime += std::chrono::steady_clock::now() - start;
+			stallCount++;
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+
+		nextToConsume++;
+		return &slot.batch;
+	}
+
+	// total time the consumer spent waiting on data
+	double stallSeconds() const noexcept {
+		return std::chrono::duration<double>(stallTime).count();
+	}
+
+	size_t stalls() const noexcept {
+		return stallCount;
+	}
+
+private:
+	enum class SlotState { free, filling, ready };
+
+	struct Slot {
+		MiniBatch batch;
+		SlotState state = SlotState::free;
+	};
+
+	size_t numBatches;
+	FillFn fill;
+	std::vector<Slot> slots;
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable slotFree;
+	std::condition_variable slotReady;
+	size_t nextToFill = 0;
+	size_t nextToConsume = 0;
+	bool stopping = false;
+	std::exception_ptr error;
+
+	std::chrono::steady_clock::duration stallTime{ 0 };
+	size_t stallCount = 0;
+
+	void workerLoop() {
+		while (true) {
+			size_t batchIndex;
+			Slot* slot;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				slotFree.wait(lock, [&] {
+					return stopping || error || nextToFill == numBatches || slots[nextToFill % slots.size()].state == SlotState::free;
+				});
+				if (stopping || error || nextToFill == numBatches) {
+					return;
+				}
+				batchIndex = nextToFill++;
+				slot = &slots[batchIndex % slots.size()];
+				slot->state = SlotState::filling;
+			}
+
+			try {
+				slot->batch.index = batchIndex;
+				fill(batchIndex, slot->batch);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				error = std::current_exception();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				slot->state = SlotState::ready;
+			}
+			slotReady.notify_all();
+			slotFree.notify_all(); // wakes idle workers so they can exit on error
+		}
+	}
+};
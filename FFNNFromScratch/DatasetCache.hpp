@@ -0,0 +1,292 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <cstring>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <filesystem>
+#include "Matrix.hpp"
+#include "Idx.hpp"
+#include "MappedFile.hpp"
+#include "Checksum.hpp"
+#include "DataPipeline.hpp"
+#include "MNISTLoader.hpp"
+#include "Checkpoint.hpp"
+
+// Preprocessed dataset cache: a 96 byte little-endian header, then the images as one contiguous
+// uint8 or float32 block, then an int32 label column. Both blocks start on 64 byte boundaries so
+// the mapped file can be read in place. pixel value = stored * scale + offset.
+enum class CachePixelType : uint32_t {
+	uint8 = 0,
+	float32 = 1
+};
+
+// size and modification time of a source file when the cache was compiled, a mismatch means the cache is stale
+struct DatasetSourceStamp {
+	uint64_t size;
+	int64_t writeTime; // file clock ticks since its epoch, only compared for equality
+
+	bool operator==(const DatasetSourceStamp&) const = default;
+};
+
+inline DatasetSourceStamp datasetSourceStamp(const std::string& filename) {
+	return { std::filesystem::file_size(filename), static_cast<int64_t>(std::filesystem::last_write_time(filename).time_since_epoch().count()) };
+}
+
+struct DatasetCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t endianMarker; // reads back as 0x01020304 only on a host with the writer's byte order
+	uint32_t pixelType;
+	uint64_t numItems;
+	uint32_t rows;
+	uint32_t cols;
+	float scale;
+	float offset;
+	uint64_t imagesOffset;
+	uint64_t labelsOffset;
+	uint32_t checksum; // crc32 of the image and label blocks
+	uint32_t reserved;
+	DatasetSourceStamp imageSource;
+	DatasetSourceStamp labelSource;
+};
+static_assert(sizeof(DatasetCacheHeader) == 96, "dataset cache header must stay 96 bytes");
+
+const uint32_t datasetCacheVersion = 2;
+const uint32_t datasetCacheEndianMarker = 0x01020304;
+
+inline uint64_t alignTo64(uint64_t offset) {
+	return (offset + 63) & ~uint64_t(63);
+}
+
+// where the compiled cache of an IDX pair lives: next to the image file, named after a hash of the
+// label file's path as well, so pairing the images with other labels gets a cache of its own
+inline std::string datasetCachePath(const std::string& imageFilename, const std::string& labelFilename) {
+	const std::string labelPath = std::filesystem::absolute(labelFilename).lexically_normal().string();
+	char key[16];
+	std::snprintf(key, sizeof(key), "%08x", crc32Update(0, reinterpret_cast<const uint8_t*>(labelPath.data()), labelPath.size()));
+	return imageFilename + "." + key + ".ffds";
+}
+
+// one-time "compile dataset" step: parses and normalizes the IDX pair and writes the cache file
+// uint8 keeps the raw bytes and stores 1/255 as the scale, float32 stores normalized values
+inline void compileDataset(const std::string& imageFilename, const std::string& labelFilename,
+	const std::string& cacheFilename, CachePixelType pixelType = CachePixelType::uint8)
+{
+	// stamped before reading, so a source edited while compiling leaves the cache stale
+	const DatasetSourceStamp imageSource = datasetSourceStamp(imageFilename);
+	const DatasetSourceStamp labelSource = datasetSourceStamp(labelFilename);
+	IdxReader images(imageFilename);
+	IdxReader labels(labelFilename);
+	const IdxHeader& imageHeader = images.header();
+	size_t rows = 0;
+	size_t cols = 0;
+	imageHeader.imageShape(rows, cols);
+	if (!labels.header().isLabelColumn() || imageHeader.numItems() != labels.header().numItems()) {
+		throw std::runtime_error("Expected a rank 1 integer label file with one label per image.");
+	}
+	if (pixelType == CachePixelType::uint8 && imageHeader.type != IdxType::uint8) {
+		throw std::runtime_error("uint8 dataset cache needs uint8 images, use float32 instead.");
+	}
+
+	DatasetCacheHeader header = {};
+	std::memcpy(header.magic, "FFDS", 4);
+	header.version = datasetCacheVersion;
+	header.endianMarker = datasetCacheEndianMarker;
+	header.pixelType = static_cast<uint32_t>(pixelType);
+	header.numItems = imageHeader.numItems();
+	header.rows = static_cast<uint32_t>(rows);
+	header.cols = static_cast<uint32_t>(cols);
+
+	const double sourceScale = imageHeader.type == IdxType::uint8 ? 1.0 / 255.0 : 1.0;
+	header.scale = pixelType == CachePixelType::uint8 ? static_cast<float>(sourceScale) : 1.0f;
+	header.offset = 0.0f;
+	header.imageSource = imageSource;
+	header.labelSource = labelSource;
+
+	const size_t sampleSize = imageHeader.itemSize();
+	const size_t pixelBytes = pixelType == CachePixelType::uint8 ? 1 : 4;
+	header.imagesOffset = alignTo64(sizeof(DatasetCacheHeader));
+	header.labelsOffset = alignTo64(header.imagesOffset + header.numItems * sampleSize * pixelBytes);
+
+	// written under a name of its own and renamed over the cache once complete, so a crash or a
+	// concurrent compile never leaves a torn cache behind
+	const std::string temp = cacheFilename + "." + std::to_string(std::random_device{}()) + ".tmp";
+	try {
+		std::ofstream file(temp, std::ios::binary);
+		if (!file.is_open()) {
+			throw std::runtime_error("Unable to open file for writing dataset cache: " + temp);
+		}
+
+		// header is rewritten at the end once the checksum is known
+		std::vector<char> padding(64, 0);
+		file.write(padding.data(), header.imagesOffset);
+
+		uint32_t crc = 0;
+		const size_t chunkItems = 1024;
+		std::vector<char> raw;
+		std::vector<float> values;
+		for (size_t start = 0; start < header.numItems; start += chunkItems) {
+			size_t count = std::min<size_t>(chunkItems, header.numItems - start);
+			if (pixelType == CachePixelType::uint8) {
+				raw.resize(count * sampleSize);
+				images.readRaw(raw.data(), count);
+			}
+			else {
+				values.resize(count * sampleSize);
+				images.readItems(values.data(), count);
+				for (auto& val : values) {
+					val = static_cast<float>(val * sourceScale);
+				}
+				raw.resize(values.size() * sizeof(float));
+				std::memcpy(raw.data(), values.data(), raw.size());
+			}
+			crc = crc32Update(crc, reinterpret_cast<const uint8_t*>(raw.data()), raw.size());
+			file.write(raw.data(), raw.size());
+		}
+
+		uint64_t written = header.imagesOffset + header.numItems * sampleSize * pixelBytes;
+		file.write(padding.data(), header.labelsOffset - written);
+
+		std::vector<int32_t> labelColumn(header.numItems);
+		labels.readItems(labelColumn.data(), header.numItems);
+		crc = crc32Update(crc, reinterpret_cast<const uint8_t*>(labelColumn.data()), labelColumn.size() * sizeof(int32_t));
+		file.write(reinterpret_cast<const char*>(labelColumn.data()), labelColumn.size() * sizeof(int32_t));
+
+		header.checksum = crc;
+		file.seekp(0);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.close();
+		if (!file) {
+			throw std::runtime_error("Failed writing dataset cache: " + temp);
+		}
+		replaceFile(temp, cacheFilename);
+	}
+	catch (...) {
+		std::remove(temp.c_str());
+		throw;
+	}
+}
+
+// Dataset backed by a memory-mapped cache file; opening it only validates the header,
+// pixels are normalized as samples are read
+class CachedDataset : public Dataset {
+public:
+	explicit CachedDataset(const std::string& cacheFilename, bool verifyChecksum = false) : file(cacheFilename) {
+		if (file.size() < sizeof(DatasetCacheHeader)) {
+			throw std::runtime_error("Dataset cache too small: " + cacheFilename);
+		}
+		std::memcpy(&header, file.data(), sizeof(header));
+
+		if (std::memcmp(header.magic, "FFDS", 4) != 0) {
+			throw std::runtime_error("Incorrect dataset cache magic: " + cacheFilename);
+		}
+		if (header.version != datasetCacheVersion) {
+			throw std::runtime_error("Unsupported dataset cache version: " + std::to_string(header.version));
+		}
+		if (header.endianMarker != datasetCacheEndianMarker) {
+			throw std::runtime_error("Dataset cache was written with a different byte order.");
+		}
+		if (header.pixelType > static_cast<uint32_t>(CachePixelType::float32)) {
+			throw std::runtime_error("Unknown dataset cache pixel type.");
+		}
+
+		const uint64_t pixelBytes = header.pixelType == static_cast<uint32_t>(CachePixelType::uint8) ? 1 : 4;
+		const uint64_t imagesEnd = header.imagesOffset + header.numItems * header.rows * header.cols * pixelBytes;
+		if (header.imagesOffset % 64 != 0 || header.labelsOffset % 64 != 0 || imagesEnd > header.labelsOffset
+			|| header.labelsOffset + header.numItems * sizeof(int32_t) > file.size()) {
+			throw std::runtime_error("Corrupt dataset cache layout: " + cacheFilename);
+		}
+
+		if (verifyChecksum && !verify()) {
+			throw std::runtime_error("Dataset cache checksum mismatch: " + cacheFilename);
+		}
+	}
+
+	// full pass over the payload, compares against the header checksum
+	bool verify() const {
+		const uint64_t pixelBytes = header.pixelType == static_cast<uint32_t>(CachePixelType::uint8) ? 1 : 4;
+		uint32_t crc = crc32Update(0, file.data() + header.imagesOffset, header.numItems * header.rows * header.cols * pixelBytes);
+		crc = crc32Update(crc, file.data() + header.labelsOffset, header.numItems * sizeof(int32_t));
+		return crc == header.checksum;
+	}
+
+	size_t size() const override {
+		return header.numItems;
+	}
+
+	void getSample(size_t index, Matrix& out) const override {
+		const size_t rows = header.rows;
+		const size_t cols = header.cols;
+		if (out.numRows() != rows || out.numCols() != cols) {
+			out = Matrix(rows, cols);
+		}
+
+		const size_t first = index * rows * cols;
+		if (header.pixelType == static_cast<uint32_t>(CachePixelType::uint8)) {
+			const uint8_t* pixels = file.data() + header.imagesOffset + first;
+			for (size_t i = 0; i < rows; i++) {
+				for (size_t j = 0; j < cols; j++) {
+					out[i][j] = pixels[i * cols + j] * static_cast<double>(header.scale) + header.offset;
+				}
+			}
+		}
+		else {
+			const float* pixels = reinterpret_cast<const float*>(file.data() + header.imagesOffset) + first;
+			for (size_t i = 0; i < rows; i++) {
+				for (size_t j = 0; j < cols; j++) {
+					out[i][j] = pixels[i * cols + j] * static_cast<double>(header.scale) + header.offset;
+				}
+			}
+		}
+	}
+
+	int getLabel(size_t index) const override {
+		return reinterpret_cast<const int32_t*>(file.data() + header.labelsOffset)[index];
+	}
+
+	// false once either source file has changed size or modification time since the cache was compiled
+	bool isCompiledFrom(const std::string& imageFilename, const std::string& labelFilename) const {
+		return header.imageSource == datasetSourceStamp(imageFilename) && header.labelSource == datasetSourceStamp(labelFilename);
+	}
+
+	const DatasetCacheHeader& getHeader() const noexcept {
+		return header;
+	}
+
+private:
+	MappedFile file;
+	DatasetCacheHeader header;
+};
+
+// Opens an IDX pair for training, preferring its compiled cache (see datasetCachePath). A missing,
+// unreadable or stale cache is compiled first when compileCache is set; otherwise, or if that fails
+// (e.g. a read-only directory), the IDX files are parsed with MNISTLoader.
+inline std::unique_ptr<Dataset> openDataset(const std::string& imageFilename, const std::string& labelFilename, bool compileCache = false) {
+	const std::string cachePath = datasetCachePath(imageFilename, labelFilename);
+	if (std::ifstream(cachePath).good()) {
+		try {
+			auto cached = std::make_unique<CachedDataset>(cachePath);
+			if (cached->isCompiledFrom(imageFilename, labelFilename)) {
+				return cached;
+			}
+			std::cerr << "Dataset cache " << cachePath << " no longer matches its source files." << std::endl;
+		}
+		catch (const std::exception& ex) {
+			std::cerr << "Ignoring dataset cache " << cachePath << ": " << ex.what() << std::endl;
+		}
+	}
+	if (compileCache) {
+		try {
+			compileDataset(imageFilename, labelFilename, cachePath);
+			return std::make_unique<CachedDataset>(cachePath);
+		}
+		catch (const std::exception& ex) {
+			std::cerr << "Unable to compile dataset cache " << cachePath << ": " << ex.what() << std::endl;
+		}
+	}
+	return std::make_unique<MNISTLoader>(imageFilename, labelFilename);
+}
@@ -0,0 +1,186 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <optional>
+#include <span>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include "InferenceSession.hpp"
+#include "ModelRegistry.hpp"
+#include "BatchScheduler.hpp"
+#include "TopK.hpp"
+
+struct BatchingOptions {
+	size_t maxBatch = 32; // most requests computed together
+	std::chrono::microseconds maxWait{ 500 }; // longest the oldest queued request waits for the batch to fill
+	size_t workers = 1; // threads, each with its own InferenceSession
+	std::chrono::microseconds latencyTarget{ 0 }; // p99 enqueue -> result; when set, batch size and wait adapt within the two limits above
+};
+
+// Coalesces single-sample requests from any number of threads into batches for InferenceSession::runBatch.
+// A worker takes a batch as soon as the batch limit is reached or the oldest request has waited the
+// window, whichever comes first. Both come from a BatchScheduler: fixed at maxBatch and maxWait, or
+// adapted to a latency target. Each batch runs on the registry's current model, so a model published
+// while the server runs is picked up by the next batch.
+class DynamicBatcher {
+public:
+	// called on a worker thread with the top-k of the request's outputs, must not throw
+	using Callback = std::function<void(std::span<const TopKEntry>)>;
+
+	DynamicBatcher(std::shared_ptr<const CompiledModel> model, const BatchingOptions& options) :
+		DynamicBatcher(std::make_shared<ModelRegistry>(std::move(model)), options)
+	{
+	}
+
+	DynamicBatcher(std::shared_ptr<ModelRegistry> registry, const BatchingOptions& options) :
+		registry(std::move(registry)), options(options), scheduler(options.maxBatch, options.maxWait, options.latencyTarget)
+	{
+		if (options.maxBatch == 0 || options.workers == 0) {
+			throw std::invalid_argument("Batching needs a max batch and worker count of at least 1.");
+		}
+		for (size_t i = 0; i < options.workers; i++) {
+			workers.emplace_back([this] { workerLoop(); });
+		}
+	}
+
+	// requests still queued are computed and answered before the workers exit
+	~DynamicBatcher() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	DynamicBatcher(const DynamicBatcher&) = delete;
+	DynamicBatcher& operator=(const DynamicBatcher&) = delete;
+
+	ModelRegistry& getRegistry() const noexcept {
+		return *registry;
+	}
+
+	BatchingMetrics getMetrics() const {
+		return scheduler.metrics();
+	}
+
+	void submit(std::span<const float> input, size_t k, Callback done) {
+		if (input.size() != registry->getNumInputs()) {
+			throw std::invalid_argument("Request has " + std::to_string(input.size()) + " inputs, the model expects " + std::to_string(registry->getNumInputs()));
+		}
+
+		Request request{ std::vector<float>(input.begin(), input.end()), k, std::move(done), std::chrono::steady_clock::now() };
+		bool notify;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(std::move(request));
+			// the first request starts a worker's deadline, a full batch releases it early
+			notify = queue.size() == 1 || queue.size() >= scheduler.batchLimit();
+		}
+		if (notify) {
+			wake.notify_one();
+		}
+	}
+
+private:
+	struct Request {
+		std::vector<float> input;
+		size_t k;
+		Callback done;
+		std::chrono::steady_clock::time_point enqueued;
+	};
+
+	std::shared_ptr<ModelRegistry> registry;
+	BatchingOptions options;
+	BatchScheduler scheduler;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Request> queue;
+	bool stopping = false;
+	std::vector<std::thread> workers;
+
+	void workerLoop() {
+		std::optional<InferenceSession> session;
+		uint64_t version = 0;
+		const size_t numInputs = registry->getNumInputs();
+		const size_t numOutputs = registry->getNumOutputs();
+		std::vector<Request> batch;
+		std::vector<float> inputs(options.maxBatch * numInputs);
+		std::vector<float> outputs(options.maxBatch * numOutputs);
+		std::vector<TopKEntry> best;
+		std::vector<double> queueDelays;
+		std::vector<double> latencies;
+		batch.reserve(options.maxBatch);
+		queueDelays.reserve(options.maxBatch);
+		latencies.reserve(options.maxBatch);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			wake.wait(lock, [this] { return !queue.empty() || stopping; });
+			if (queue.empty()) {
+				return;
+			}
+
+			const auto deadline = queue.front().enqueued + scheduler.window();
+			wake.wait_until(lock, deadline, [this] { return queue.size() >= scheduler.batchLimit() || stopping || queue.empty(); });
+			if (queue.empty()) {
+				continue; // another worker took them
+			}
+
+			const size_t count = std::min(scheduler.batchLimit(), queue.size());
+			for (size_t i = 0; i < count; i++) {
+				batch.push_back(std::move(queue.front()));
+				queue.pop_front();
+			}
+			if (!queue.empty()) {
+				wake.notify_one(); // the rest starts another worker's deadline
+			}
+			lock.unlock();
+
+			const auto taken = std::chrono::steady_clock::now();
+			{
+				// a new session only when the model was swapped, it keeps its model alive by itself
+				auto current = registry->read();
+				if (current->version != version) {
+					session.emplace(current->model);
+					version = current->version;
+				}
+			}
+			for (size_t i = 0; i < count; i++) {
+				std::copy(batch[i].input.begin(), batch[i].input.end(), inputs.begin() + i * numInputs);
+			}
+			session->runBatch(std::span<const float>(inputs.data(), count * numInputs), std::span<float>(outputs.data(), count * numOutputs), count);
+			const auto computed = std::chrono::steady_clock::now();
+
+			for (const Request& request : batch) {
+				queueDelays.push_back(std::chrono::duration<double, std::micro>(taken - request.enqueued).count());
+				latencies.push_back(std::chrono::duration<double, std::micro>(computed - request.enqueued).count());
+			}
+			scheduler.record(std::chrono::duration<double, std::micro>(computed - taken).count(), queueDelays, latencies);
+			queueDelays.clear();
+			latencies.clear();
+			// one top-k pass over the batch for the largest k asked for, each request gets its prefix
+			size_t k = 0;
+			for (const Request& request : batch) {
+				k = std::max(k, std::min(request.k, numOutputs));
+			}
+			best.resize(count * k);
+			topKBatch(outputs.data(), numOutputs, count, k, best.data());
+			for (size_t i = 0; i < count; i++) {
+				batch[i].done(std::span<const TopKEntry>(best.data() + i * k, std::min(batch[i].k, numOutputs)));
+			}
+			batch.clear();
+
+			lock.lock();
+		}
+	}
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdio>
+#include "FFNN.hpp"
+
+// one threshold of the early-exit trade-off curve
+struct EarlyExitPoint {
+	double threshold; // above 1 nothing exits early, the full network baseline
+	double accuracy;
+	double averageLayers; // layers computed per sample
+	double microsPerSample; // forward() wall time
+	std::vector<double> exitShare; // share of samples answered by each head, then by the last layer
+};
+
+// Runs the test set through forward() once per threshold and prints accuracy, average depth and
+// latency for each, so a threshold can be picked from the curve. The model needs exit heads
+// (FFNN::addExitHead) trained with it. Its prediction cache is off while measuring, and the
+// threshold and cache are restored afterwards.
+inline std::vector<EarlyExitPoint> reportEarlyExit(FFNN& model, const std::vector<Matrix>& testData, const std::vector<int>& targets,
+	const std::vector<double>& thresholds = { 0.5, 0.7, 0.8, 0.9, 0.95, 0.99, 0.999, 2.0 })
+{
+	std::shared_ptr<PredictionCache> cache = model.getPredictionCache();
+	const double previousThreshold = model.getExitThreshold();
+	model.setPredictionCache(nullptr);
+
+	std::vector<EarlyExitPoint> curve;
+	std::printf("threshold   accuracy   layers   us/sample   exits (heads..., last layer)\n");
+	for (double threshold : thresholds) {
+		model.setExitThreshold(threshold);
+		model.resetExitStats();
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<Matrix> outputs = model.forward(testData);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		size_t correct = 0;
+		for (size_t i = 0; i < outputs.size(); i++) {
+			correct += model.getPrediction(outputs[i]) == targets[i];
+		}
+
+		EarlyExitPoint point{ threshold, testData.empty() ? 0.0 : 100.0 * correct / testData.size(), model.getAverageLayersExecuted(),
+			testData.empty() ? 0.0 : 1e6 * seconds / testData.size(), {} };
+		for (uint64_t count : model.getExitCounts()) {
+			point.exitShare.push_back(testData.empty() ? 0.0 : 100.0 * count / testData.size());
+		}
+
+		if (threshold > 1.0) {
+			std::printf("    (none)");
+		}
+		else {
+			std::printf("%10.3f", threshold);
+		}
+		std::printf("   %7.2f%%   %6.2f   %9.1f   ", point.accuracy, point.averageLayers, point.microsPerSample);
+		for (double share : point.exitShare) {
+			std::printf(" %5.1f%%", share);
+		}
+		std::printf("\n");
+		curve.push_back(std::move(point));
+	}
+
+	model.setExitThreshold(previousThreshold);
+	model.setPredictionCache(cache);
+	return curve;
+}
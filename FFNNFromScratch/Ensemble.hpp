@@ -0,0 +1,301 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <memory>
+#include <string>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+#include "Layer.hpp"
+#include "Serialize.hpp"
+#include "InferenceSession.hpp"
+#include "LatencyBenchmark.hpp"
+#include "FFNN.hpp"
+
+// K networks over the same inputs, compiled into one plan whose prediction is the average of their
+// outputs. Layer l of the plan computes layer l of every member into one activation vector where each
+// member owns a slice padded to 8 floats:
+//   - the first layer reads the shared input, so when the members agree on its activation their
+//     weights are stacked into one wide matrix and computed as a single product; the input is
+//     loaded once for all K instead of once per member
+//   - later layers are block diagonal, member k only reads its own slice, so they run as K products
+//     over the same batch and never touch the zero blocks
+// Members need the same input count, output count and depth; hidden widths and activations may differ.
+class CompiledEnsemble {
+public:
+	// one dense product of a fused layer: reads plan.stride floats at inOffset and writes plan.rows at outOffset
+	struct Block {
+		CompiledModel::LayerPlan plan;
+		size_t inOffset;
+		size_t outOffset;
+	};
+
+	struct FusedLayer {
+		std::vector<Block> blocks;
+		std::vector<size_t> memberOffsets; // where each member's slice starts
+		std::vector<size_t> memberRows; // real outputs in each slice, the rest up to the next slice is padding
+		size_t width; // floats per sample the layer writes, padding included
+	};
+
+	explicit CompiledEnsemble(const std::vector<std::vector<Layer>>& members) {
+		if (members.empty()) {
+			throw std::invalid_argument("An ensemble needs at least one member.");
+		}
+		std::vector<CompiledModel> compiled;
+		for (const auto& layers : members) {
+			compiled.emplace_back(layers);
+		}
+
+		const CompiledModel& first = compiled.front();
+		for (size_t k = 1; k < compiled.size(); k++) {
+			if (compiled[k].numInputs() != first.numInputs() || compiled[k].numOutputs() != first.numOutputs()
+				|| compiled[k].getLayers().size() != first.getLayers().size()) {
+				throw std::invalid_argument("Ensemble member " + std::to_string(k) + " differs from the first in inputs, outputs or depth.");
+			}
+		}
+
+		for (size_t l = 0; l < first.getLayers().size(); l++) {
+			FusedLayer fused;
+			fused.width = 0;
+			for (const CompiledModel& member : compiled) {
+				const size_t rows = member.getLayers()[l].rows;
+				fused.memberOffsets.push_back(fused.width);
+				fused.memberRows.push_back(rows);
+				fused.width += (rows + 7) & ~size_t(7);
+			}
+
+			const bool stack = l == 0 && std::all_of(compiled.begin(), compiled.end(), [&](const CompiledModel& member) {
+				return member.getLayers()[0].activation == first.getLayers()[0].activation;
+			});
+			if (stack) {
+				fused.blocks.push_back({ stackFirstLayers(compiled, fused), 0, 0 });
+			}
+			else {
+				for (size_t k = 0; k < compiled.size(); k++) {
+					const size_t inOffset = l == 0 ? 0 : layers.back().memberOffsets[k];
+					fused.blocks.push_back({ compiled[k].getLayers()[l], inOffset, fused.memberOffsets[k] });
+				}
+			}
+			layers.push_back(std::move(fused));
+		}
+
+		inputStride = first.getLayers().front().stride;
+		maxWidth = inputStride;
+		for (const FusedLayer& layer : layers) {
+			maxWidth = std::max(maxWidth, layer.width);
+		}
+		memberCount = compiled.size();
+		inputs = first.numInputs();
+		outputs = first.numOutputs();
+	}
+
+	static std::shared_ptr<const CompiledEnsemble> fromFiles(const std::vector<std::string>& filenames) {
+		std::vector<std::vector<Layer>> members;
+		for (const std::string& filename : filenames) {
+			members.push_back(readModel(filename));
+		}
+		return std::make_shared<const CompiledEnsemble>(members);
+	}
+
+	size_t numMembers() const noexcept {
+		return memberCount;
+	}
+
+	size_t numInputs() const noexcept {
+		return inputs;
+	}
+
+	size_t numOutputs() const noexcept {
+		return outputs;
+	}
+
+	// floats the first layer reads per sample, the input zero-padded to 8
+	size_t getInputStride() const noexcept {
+		return inputStride;
+	}
+
+	// widest activation vector any fused layer reads or writes
+	size_t bufferSize() const noexcept {
+		return maxWidth;
+	}
+
+	const std::vector<FusedLayer>& getLayers() const noexcept {
+		return layers;
+	}
+
+private:
+	std::vector<FusedLayer> layers;
+	size_t memberCount = 0;
+	size_t inputs = 0;
+	size_t outputs = 0;
+	size_t inputStride = 0;
+	size_t maxWidth = 0;
+
+	// the members' first layers as rows of one matrix, zero rows filling each slice's padding
+	static CompiledModel::LayerPlan stackFirstLayers(const std::vector<CompiledModel>& compiled, const FusedLayer& fused) {
+		const CompiledModel::LayerPlan& first = compiled.front().getLayers().front();
+		CompiledModel::LayerPlan stacked;
+		stacked.rows = fused.width;
+		stacked.cols = first.cols;
+		stacked.stride = first.stride;
+		stacked.activation = first.activation;
+		stacked.weights.assign(stacked.rows * stacked.stride, 0.0f);
+		stacked.biases.assign(stacked.rows, 0.0f);
+		for (size_t k = 0; k < compiled.size(); k++) {
+			const CompiledModel::LayerPlan& plan = compiled[k].getLayers().front();
+			const size_t offset = fused.memberOffsets[k];
+			std::copy(plan.weights.begin(), plan.weights.end(), stacked.weights.begin() + offset * stacked.stride);
+			std::copy(plan.biases.begin(), plan.biases.end(), stacked.biases.begin() + offset);
+		}
+		return stacked;
+	}
+};
+
+// Per-thread execution state for a CompiledEnsemble, the counterpart of InferenceSession: two
+// activation buffers for batchTile samples and no allocation per call.
+class EnsembleSession {
+public:
+	static constexpr size_t batchTile = InferenceSession::batchTile;
+
+	explicit EnsembleSession(std::shared_ptr<const CompiledEnsemble> ensemble) :
+		ensemble(std::move(ensemble)), ping(batchTile * this->ensemble->bufferSize(), 0.0f), pong(batchTile * this->ensemble->bufferSize(), 0.0f)
+	{
+	}
+
+	const CompiledEnsemble& getEnsemble() const noexcept {
+		return *ensemble;
+	}
+
+	// one sample: numInputs() values in, the members' mean numOutputs() values out
+	void run(std::span<const float> input, std::span<float> output) {
+		if (input.size() != ensemble->numInputs() || output.size() != ensemble->numOutputs()) {
+			throw std::invalid_argument("Input or output span does not match the ensemble.");
+		}
+		runTile(input.data(), output.data(), 1);
+	}
+
+	// count samples stored back to back
+	void runBatch(std::span<const float> inputs, std::span<float> outputs, size_t count) {
+		const size_t numInputs = ensemble->numInputs();
+		const size_t numOutputs = ensemble->numOutputs();
+		if (inputs.size() != count * numInputs || outputs.size() != count * numOutputs) {
+			throw std::invalid_argument("Batch spans do not match the ensemble.");
+		}
+		for (size_t first = 0; first < count; first += batchTile) {
+			runTile(inputs.data() + first * numInputs, outputs.data() + first * numOutputs, std::min(batchTile, count - first));
+		}
+	}
+
+	// index of the largest averaged output for one sample
+	int classify(std::span<const float> input, std::span<float> output) {
+		run(input, output);
+		return static_cast<int>(std::max_element(output.begin(), output.end()) - output.begin());
+	}
+
+private:
+	std::shared_ptr<const CompiledEnsemble> ensemble;
+	std::vector<float> ping;
+	std::vector<float> pong;
+
+	void runTile(const float* input, float* output, size_t count) {
+		const size_t numInputs = ensemble->numInputs();
+		const size_t numOutputs = ensemble->numOutputs();
+		size_t inStride = ensemble->getInputStride();
+		for (size_t s = 0; s < count; s++) {
+			std::copy(input + s * numInputs, input + (s + 1) * numInputs, ping.begin() + s * inStride);
+			std::fill(ping.begin() + s * inStride + numInputs, ping.begin() + (s + 1) * inStride, 0.0f);
+		}
+
+		float* in = ping.data();
+		float* out = pong.data();
+		for (const CompiledEnsemble::FusedLayer& layer : ensemble->getLayers()) {
+			const size_t outStride = layer.width;
+			for (const CompiledEnsemble::Block& block : layer.blocks) {
+				InferenceSession::runLayer(block.plan, in + block.inOffset, inStride, out + block.outOffset, outStride, count);
+			}
+			// zero each slice's padding, the next layer's dot products read it
+			const size_t members = layer.memberOffsets.size();
+			for (size_t s = 0; s < count; s++) {
+				float* sample = out + s * outStride;
+				for (size_t k = 0; k < members; k++) {
+					const size_t end = k + 1 < members ? layer.memberOffsets[k + 1] : outStride;
+					std::fill(sample + layer.memberOffsets[k] + layer.memberRows[k], sample + end, 0.0f);
+				}
+			}
+			std::swap(in, out);
+			inStride = outStride;
+		}
+
+		const auto& offsets = ensemble->getLayers().back().memberOffsets;
+		const float scale = 1.0f / offsets.size();
+		for (size_t s = 0; s < count; s++) {
+			const float* sample = in + s * inStride;
+			for (size_t i = 0; i < numOutputs; i++) {
+				float sum = 0.0f;
+				for (size_t offset : offsets) {
+					sum += sample[offset + i];
+				}
+				output[s * numOutputs + i] = sum * scale;
+			}
+		}
+	}
+};
+
+// per-sample latency of K separate FFNN::forward calls, K InferenceSessions and the fused ensemble,
+// with each member's accuracy on the samples next to the ensemble's
+inline void benchmarkEnsemble(std::vector<FFNN>& members, const std::vector<Matrix>& samples, const std::vector<int>& targets) {
+	std::vector<std::vector<Layer>> layers;
+	for (FFNN& member : members) {
+		layers.push_back(member.getLayers());
+	}
+	auto ensemble = std::make_shared<const CompiledEnsemble>(layers);
+	const size_t numInputs = ensemble->numInputs();
+	const size_t numOutputs = ensemble->numOutputs();
+	std::vector<float> inputs(samples.size() * numInputs);
+	for (size_t i = 0; i < samples.size(); i++) {
+		std::copy(samples[i].data(), samples[i].data() + numInputs, inputs.begin() + i * numInputs);
+	}
+	auto input = [&](size_t i) {
+		return std::span<const float>(inputs.data() + i * numInputs, numInputs);
+	};
+
+	auto measure = [&](const char* name, auto&& runOne) {
+		printCallLatency(name, 24, samples.size(), runOne);
+	};
+
+	std::printf("%zu members, %zu samples\n", members.size(), samples.size());
+	std::vector<Matrix> single(1);
+	measure("K x FFNN::forward", [&](size_t i) {
+		single[0] = samples[i];
+		for (FFNN& member : members) {
+			member.forward(single);
+		}
+	});
+
+	std::vector<InferenceSession> sessions;
+	for (FFNN& member : members) {
+		sessions.emplace_back(member.compile());
+	}
+	std::vector<float> output(numOutputs);
+	std::vector<size_t> memberCorrect(members.size(), 0);
+	measure("K x InferenceSession", [&](size_t i) {
+		for (size_t k = 0; k < sessions.size(); k++) {
+			if (sessions[k].classify(input(i), output) == targets[i]) {
+				memberCorrect[k]++;
+			}
+		}
+	});
+
+	EnsembleSession fused(ensemble);
+	size_t ensembleCorrect = 0;
+	measure("EnsembleSession", [&](size_t i) {
+		if (fused.classify(input(i), output) == targets[i]) {
+			ensembleCorrect++;
+		}
+	});
+
+	for (size_t k = 0; k < members.size(); k++) {
+		std::printf("member %zu accuracy %.2f%%\n", k, 100.0 * memberCorrect[k] / samples.size());
+	}
+	std::printf("ensemble accuracy %.2f%%\n", 100.0 * ensembleCorrect / samples.size());
+}
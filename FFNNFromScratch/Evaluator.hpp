@@ -0,0 +1,199 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <memory>
+#include <atomic>
+#include <latch>
+#include <mutex>
+#include <exception>
+#include <string>
+#include <thread>
+#include <ostream>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+#include "Matrix.hpp"
+#include "DataPipeline.hpp"
+#include "InferenceSession.hpp"
+#include "ThreadPool.hpp"
+#include "TopK.hpp"
+
+// Counts reduced over an evaluated dataset. confusion is numClasses x numClasses, row = true label,
+// column = predicted class. Samples whose label is not one of the model's outputs count as wrong
+// and are left out of the matrix.
+struct EvaluationReport {
+	size_t numClasses = 0;
+	std::vector<uint64_t> confusion;
+	uint64_t samples = 0;
+	uint64_t correct = 0;
+	double squaredError = 0.0; // summed per-sample mean squared error against the one-hot label
+
+	explicit EvaluationReport(size_t numClasses = 0) : numClasses(numClasses), confusion(numClasses * numClasses, 0) {}
+
+	uint64_t count(size_t actual, size_t predicted) const {
+		return confusion[actual * numClasses + predicted];
+	}
+
+	// percentage, like FFNN::eval
+	double accuracy() const noexcept {
+		return samples > 0 ? 100.0 * correct / samples : 0.0;
+	}
+
+	// mean over samples of the loss train() prints per epoch
+	double loss() const noexcept {
+		return samples > 0 ? squaredError / samples : 0.0;
+	}
+
+	// of the samples predicted as cls, the share that were cls
+	double precision(size_t cls) const {
+		uint64_t predicted = 0;
+		for (size_t actual = 0; actual < numClasses; actual++) {
+			predicted += count(actual, cls);
+		}
+		return predicted > 0 ? static_cast<double>(count(cls, cls)) / predicted : 0.0;
+	}
+
+	// of the samples labelled cls, the share predicted as cls
+	double recall(size_t cls) const {
+		uint64_t actual = 0;
+		for (size_t predicted = 0; predicted < numClasses; predicted++) {
+			actual += count(cls, predicted);
+		}
+		return actual > 0 ? static_cast<double>(count(cls, cls)) / actual : 0.0;
+	}
+
+	void merge(const EvaluationReport& other) {
+		if (other.numClasses != numClasses) {
+			throw std::invalid_argument("Cannot merge evaluation reports over different numbers of classes.");
+		}
+		for (size_t i = 0; i < confusion.size(); i++) {
+			confusion[i] += other.confusion[i];
+		}
+		samples += other.samples;
+		correct += other.correct;
+		squaredError += other.squaredError;
+	}
+
+	// accuracy and loss, per-class precision and recall, then the confusion matrix
+	void print(std::ostream& out) const {
+		char line[96];
+		std::snprintf(line, sizeof(line), "Accuracy: %.2f%%  Loss: %.6f  (%llu samples)\n", accuracy(), loss(), static_cast<unsigned long long>(samples));
+		out << line << "class  precision  recall\n";
+		for (size_t c = 0; c < numClasses; c++) {
+			std::snprintf(line, sizeof(line), "%5zu  %8.2f%%  %6.2f%%\n", c, 100.0 * precision(c), 100.0 * recall(c));
+			out << line;
+		}
+		out << "confusion (rows actual, columns predicted)\n";
+		for (size_t actual = 0; actual < numClasses; actual++) {
+			for (size_t predicted = 0; predicted < numClasses; predicted++) {
+				std::snprintf(line, sizeof(line), "%7llu", static_cast<unsigned long long>(count(actual, predicted)));
+				out << line;
+			}
+			out << "\n";
+		}
+	}
+};
+
+// Evaluates a compiled model over a Dataset without holding its outputs. Each pool thread claims
+// chunks of chunkSize samples in turn, gathers them into its own input buffer, runs them through its
+// own InferenceSession and folds the outputs into its own report; the reports are merged at the end.
+// Memory is a chunk per thread whatever the dataset size. A sample that fails to load or has the
+// wrong size stops the other threads and is rethrown by evaluate().
+class Evaluator {
+public:
+	explicit Evaluator(std::shared_ptr<const CompiledModel> model, size_t threads = 0, size_t chunkSize = 256) :
+		model(std::move(model)), chunkSize(std::max<size_t>(chunkSize, 1)), pool(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency()))
+	{
+	}
+
+	// evaluate newer weights on the same threads, e.g. after each epoch
+	void setModel(std::shared_ptr<const CompiledModel> newModel) {
+		model = std::move(newModel);
+	}
+
+	EvaluationReport evaluate(const Dataset& data) {
+		const size_t numChunks = (data.size() + chunkSize - 1) / chunkSize;
+		const size_t workers = std::min(pool.size(), numChunks);
+		std::vector<EvaluationReport> partial(workers, EvaluationReport(model->numOutputs()));
+		std::atomic<size_t> nextChunk{ 0 };
+		std::mutex errorMutex;
+		std::exception_ptr error;
+		std::latch done(workers);
+		for (size_t t = 0; t < workers; t++) {
+			pool.submit([&, t] {
+				try {
+					evaluateChunks(data, nextChunk, numChunks, partial[t]);
+				}
+				catch (...) {
+					// an exception leaving a pool task ends the program, hand it to the caller instead
+					std::lock_guard<std::mutex> lock(errorMutex);
+					if (!error) {
+						error = std::current_exception();
+					}
+					nextChunk = numChunks; // the other threads stop after their current chunk
+				}
+				done.count_down();
+			});
+		}
+		done.wait();
+		if (error) {
+			std::rethrow_exception(error);
+		}
+
+		EvaluationReport report(model->numOutputs());
+		for (const EvaluationReport& part : partial) {
+			report.merge(part);
+		}
+		return report;
+	}
+
+private:
+	std::shared_ptr<const CompiledModel> model;
+	size_t chunkSize;
+	ThreadPool pool;
+
+	void evaluateChunks(const Dataset& data, std::atomic<size_t>& nextChunk, size_t numChunks, EvaluationReport& report) const {
+		const size_t numInputs = model->numInputs();
+		const size_t numOutputs = model->numOutputs();
+		InferenceSession session(model);
+		std::vector<float> inputs(chunkSize * numInputs);
+		std::vector<float> outputs(chunkSize * numOutputs);
+		std::vector<int> predictions(chunkSize);
+		Matrix sample;
+
+		for (size_t chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++) {
+			const size_t first = chunk * chunkSize;
+			const size_t count = std::min(chunkSize, data.size() - first);
+			for (size_t s = 0; s < count; s++) {
+				data.getSample(first + s, sample);
+				if (sample.numRows() * sample.numCols() != numInputs) {
+					throw std::invalid_argument("Sample " + std::to_string(first + s) + " has " + std::to_string(sample.numRows() * sample.numCols())
+						+ " values, the model takes " + std::to_string(numInputs));
+				}
+				std::copy(sample.data(), sample.data() + numInputs, inputs.begin() + s * numInputs);
+			}
+			session.runBatch(std::span<const float>(inputs.data(), count * numInputs), std::span<float>(outputs.data(), count * numOutputs), count);
+			argmaxBatch(outputs.data(), numOutputs, count, predictions.data());
+
+			for (size_t s = 0; s < count; s++) {
+				const float* out = outputs.data() + s * numOutputs;
+				const int label = data.getLabel(first + s);
+				const size_t predicted = predictions[s];
+				const bool known = label >= 0 && static_cast<size_t>(label) < numOutputs;
+
+				double sum = 0.0;
+				for (size_t i = 0; i < numOutputs; i++) {
+					const double diff = out[i] - (known && i == static_cast<size_t>(label) ? 1.0 : 0.0);
+					sum += diff * diff;
+				}
+				report.squaredError += sum / numOutputs;
+				report.samples++;
+				if (known) {
+					report.confusion[label * numOutputs + predicted]++;
+					report.correct += predicted == static_cast<size_t>(label);
+				}
+			}
+		}
+	}
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include "Utils.hpp"
+#include <algorithm>
 #include <numeric>
 #include <random>
 #include <cassert>
@@ -7,27 +8,171 @@
 #include "Layer.hpp"
 #include "Matrix.hpp"
 #include "ActivationFunction.hpp"
+#include "DataPipeline.hpp"
+#include "StreamingDataset.hpp"
+#include "Augment.hpp"
+#include "Serialize.hpp"
+#include "Checkpoint.hpp"
+#include "InferenceSession.hpp"
+#include "PredictionCache.hpp"
+#include "Evaluator.hpp"
+#include "TopK.hpp"
+#include <memory>
 
 struct Gradients {
     std::vector<Matrix> weightGradients;
     std::vector<Matrix> biasGradients;
+    std::vector<Matrix> headWeightGradients; // one per exit head
+    std::vector<Matrix> headBiasGradients;
+};
+
+// lightweight classifier after a hidden layer, its softmax lets easy inputs leave the network early
+struct ExitHead {
+    size_t afterLayer; // index of the hidden layer whose activations it reads
+    Layer classifier; // hidden width -> number of outputs, softmax on top
+    double lossWeight; // scale of this head's cross-entropy gradient in joint training
 };
 
 class FFNN {
 public:
     // constructor
-    FFNN(const std::vector<int>& layerSizes)
+    FFNN(const std::vector<int>& layerSizes, Activations activation = Activations::sigmoid) :
+        shuffleSeed(std::chrono::system_clock::now().time_since_epoch().count())
     {
         for (size_t i = 0; i < layerSizes.size() - 1; i++) {
             // ex: layerSizes = {724, 128, 64, 32}
             // layers = (724, 128}, {128, 64}, {64, 32}
-            layers.emplace_back(Layer(layerSizes[i + 1], layerSizes[i]));
+            layers.emplace_back(Layer(layerSizes[i + 1], layerSizes[i], activation));
         }
     }
 
+    // network built from already initialized layers
+    explicit FFNN(std::vector<Layer> layers) :
+        layers(std::move(layers)), shuffleSeed(std::chrono::system_clock::now().time_since_epoch().count())
+    {
+    }
+
+    // builds the network described by a model file, topology and activations included
+    static FFNN fromFile(const std::string& filename) {
+        return FFNN(readModel(filename));
+    }
+
+    // same as fromFile, but the weights stay in a shared read-only mapping of the file (see mapModel)
+    static FFNN fromFileMapped(const std::string& filename) {
+        return FFNN(mapModel(filename));
+    }
+
+    // immutable float plan of the current weights for InferenceSession, safe to share between threads
+    std::shared_ptr<const CompiledModel> compile() const {
+        return std::make_shared<const CompiledModel>(layers);
+    }
+
     // used for testing the model on data after it has been trained
     // inputs = test data
-    std::vector<Matrix> forward(const std::vector<Matrix> inputs) {
+    // with a prediction cache set, repeated inputs are answered from it and every output is rounded to float
+    std::vector<Matrix> forward(const std::vector<Matrix>& inputs) {
+        if (!predictionCache) {
+            std::vector<Matrix> outputs;
+            outputs.reserve(inputs.size());
+            for (const auto& input : inputs) {
+                outputs.push_back(forwardOne(input));
+            }
+            return outputs;
+        }
+
+        const size_t numOutputs = layers.back().weights.numRows();
+        std::vector<Matrix> outputs;
+        outputs.reserve(inputs.size());
+        for (const auto& input : inputs) {
+            PredictionCache::quantize(std::span<const double>(input.data(), input.numRows() * input.numCols()), cacheKey);
+            const uint64_t hash = PredictionCache::hash(cacheKey);
+            cachedOutputs.resize(numOutputs);
+            if (!predictionCache->lookup(cacheKey, hash, weightsGeneration, cachedOutputs)) {
+                Matrix computed = forwardOne(input);
+                std::copy(computed.data(), computed.data() + numOutputs, cachedOutputs.begin());
+                predictionCache->insert(cacheKey, hash, weightsGeneration, cachedOutputs);
+            }
+            Matrix output(numOutputs, 1);
+            std::copy(cachedOutputs.begin(), cachedOutputs.end(), output.data());
+            outputs.push_back(std::move(output));
+        }
+        return outputs;
+    }
+
+    // cache in front of forward() for inputs seen before, may be shared with other networks; nullptr turns it off.
+    // Training invalidates this network's entries by itself, call this again after changing weights through getLayers().
+    void setPredictionCache(std::shared_ptr<PredictionCache> cache) {
+        predictionCache = std::move(cache);
+        weightsGeneration = PredictionCache::newGeneration();
+    }
+
+    const std::shared_ptr<PredictionCache>& getPredictionCache() const noexcept {
+        return predictionCache;
+    }
+
+    // attaches a new exit head after hidden layer afterLayer (0 is the first hidden layer), trained
+    // together with the network from then on. Checkpoints store the base layers only, so heads cannot be
+    // added while checkpointing is on or a resumed checkpoint has not been trained from yet.
+    void addExitHead(size_t afterLayer, double lossWeight = 0.5) {
+        if (afterLayer + 1 >= layers.size()) {
+            throw std::invalid_argument("An exit head must follow a hidden layer.");
+        }
+        addExitHead(afterLayer, Layer(layers.back().weights.numRows(), layers[afterLayer].weights.numRows()), lossWeight);
+    }
+
+    // attaches a trained head, e.g. one stored with saveModel({ head.classifier }, file) and read back with readModel
+    void addExitHead(size_t afterLayer, Layer classifier, double lossWeight = 0.5) {
+        if (checkpointer || resumePending) {
+            throw std::runtime_error("Exit heads are not stored in checkpoints, attach them without checkpointing or resuming.");
+        }
+        if (afterLayer + 1 >= layers.size() || classifier.weights.numCols() != layers[afterLayer].weights.numRows()
+            || classifier.weights.numRows() != layers.back().weights.numRows()) {
+            throw std::invalid_argument("Exit head does not fit after layer " + std::to_string(afterLayer));
+        }
+        for (const auto& head : exitHeads) {
+            if (head.afterLayer == afterLayer) {
+                throw std::invalid_argument("Layer " + std::to_string(afterLayer) + " already has an exit head.");
+            }
+        }
+        exitHeads.push_back({ afterLayer, std::move(classifier), lossWeight });
+        std::sort(exitHeads.begin(), exitHeads.end(), [](const ExitHead& a, const ExitHead& b) { return a.afterLayer < b.afterLayer; });
+        exitCounts.assign(exitHeads.size() + 1, 0);
+        weightsGeneration = PredictionCache::newGeneration();
+    }
+
+    const std::vector<ExitHead>& getExitHeads() const noexcept {
+        return exitHeads;
+    }
+
+    // forward() answers with the first exit head whose largest softmax probability reaches threshold,
+    // anything above 1 (the default) runs every layer
+    void setExitThreshold(double threshold) {
+        exitThreshold = threshold;
+        weightsGeneration = PredictionCache::newGeneration();
+    }
+
+    double getExitThreshold() const noexcept {
+        return exitThreshold;
+    }
+
+    // layers forward() computed per input since the last resetExitStats(), cache hits not included
+    double getAverageLayersExecuted() const noexcept {
+        uint64_t inputs = std::accumulate(exitCounts.begin(), exitCounts.end(), uint64_t(0));
+        return inputs > 0 ? static_cast<double>(layersExecuted) / inputs : 0.0;
+    }
+
+    // inputs answered by each exit head in order, then by the last layer
+    const std::vector<uint64_t>& getExitCounts() const noexcept {
+        return exitCounts;
+    }
+
+    void resetExitStats() {
+        exitCounts.assign(exitHeads.size() + 1, 0);
+        layersExecuted = 0;
+    }
+
+    // the uncached forward pass through every layer, training always uses this one
+    std::vector<Matrix> computeOutputs(const std::vector<Matrix>& inputs) {
         std::vector<Matrix> layer_outputs;
         Matrix current_input;
 
@@ -47,53 +192,204 @@ public:
     void train(const std::vector<Matrix>& Xtrain, const std::vector<int>& Ytrain, int epochs, int miniBatchSize, double learningRate) {
         assert(Xtrain.size() == Ytrain.size());
 
-        for (int epoch = 0; epoch < epochs; epoch++) {
+        MatrixDataset data(Xtrain, Ytrain);
+        train(data, epochs, miniBatchSize, learningRate);
+    }
+
+    // mini-batches are gathered on prefetch worker threads while the current one trains
+    void train(const Dataset& data, int epochs, int miniBatchSize, double learningRate) {
+        const size_t numSamples = data.size();
+        const size_t numBatches = (numSamples + miniBatchSize - 1) / miniBatchSize;
+        TrainingState start = takeResumeState();
+        std::unique_ptr<Evaluator> validator = validationData ? std::make_unique<Evaluator>(compile()) : nullptr;
+        const bool streamFirstEpoch = data.loadsInOrder(); // decided once, the loader finishes during the epoch
+
+        for (int epoch = static_cast<int>(start.epoch); epoch < epochs; epoch++) {
             std::cout << "Epoch: " << epoch << "\t";
             double epochLoss = 0.0; // Track error for each epoch
 
-            // Seed the random number generator
-            std::default_random_engine gen(std::chrono::system_clock::now().time_since_epoch().count());
+            // Seed the random number generator, the same seed and epoch always give the same order
+            std::mt19937_64 gen(mixSeed(shuffleSeed ^ epoch));
 
-            // Shuffle training data
-            std::vector<size_t> indices(Xtrain.size());
+            // Shuffle training data. A dataset still loading front to back when training starts is
+            // shuffled within consecutive windows in the first epoch, so its batches only wait on the
+            // loaded prefix; a fully loaded one is shuffled as a whole
+            std::vector<size_t> indices(numSamples);
             std::iota(indices.begin(), indices.end(), 0);
-            std::shuffle(indices.begin(), indices.end(), gen);
+            const size_t window = epoch == 0 && streamFirstEpoch ? firstEpochWindow : numSamples;
+            for (size_t begin = 0; begin < numSamples; begin += window) {
+                std::shuffle(indices.begin() + begin, indices.begin() + std::min(begin + window, numSamples), gen);
+            }
+
+            // a resumed epoch skips the batches its checkpoint already covered
+            size_t firstBatch = epoch == static_cast<int>(start.epoch) ? std::min<size_t>(start.batchInEpoch, numBatches) : 0;
 
-            // Divide data into mini-batches
-            for (size_t i = 0; i < Xtrain.size(); i += miniBatchSize) {
-                std::vector<Matrix> miniBatchData;
-                std::vector<int> miniBatchTargets;
+            // Divide data into mini-batches, filled ahead of time by the prefetcher
+            BatchPrefetcher prefetcher(numBatches - firstBatch, prefetchDepth, prefetchWorkers, [&](size_t batchIndex, MiniBatch& batch) {
+                size_t begin = (firstBatch + batchIndex) * miniBatchSize;
+                size_t end = std::min(begin + miniBatchSize, numSamples);
 
                 // Collect mini-batch data and targets
-                for (size_t j = i; j < std::min(i + miniBatchSize, Xtrain.size()); j++) {
-                    miniBatchData.push_back(Xtrain[indices[j]]);
-                    miniBatchTargets.push_back(Ytrain[indices[j]]);
+                batch.data.resize(end - begin);
+                batch.targets.resize(end - begin);
+                for (size_t j = begin; j < end; j++) {
+                    data.getSample(indices[j], batch.data[j - begin]);
+                    batch.targets[j - begin] = data.getLabel(indices[j]);
+                    if (augmenter) {
+                        augmenter->apply(batch.data[j - begin], epoch, indices[j]);
+                    }
                 }
+            });
+
+            while (const MiniBatch* batch = prefetcher.next()) {
+                epochLoss += trainOnBatch(batch->data, batch->targets, learningRate);
+                maybeCheckpoint(epoch, firstBatch + batch->index + 1, numBatches);
+            }
 
-                // forward pass for the mini-batch
-                std::vector<Matrix> outputs = forward(miniBatchData);
+            // Output epoch loss and how long training sat waiting on data
+            std::cout << "Loss: " << (epochLoss / numSamples) << "\tData stall: " << prefetcher.stallSeconds() * 1000.0 << " ms";
+            printValidation(validator);
+        }
 
-                // encode target vector into a 32 x 1 vector of 10 x 1 matrices
-                std::vector<Matrix> oneHotLabels = createOneHotTargets(miniBatchTargets, 10);
+        if (checkpointer) {
+            checkpointer->flush();
+        }
+    }
 
-                // calc mse for mini-batch
-                double miniBatchLoss = 0.0;
-                for (size_t i = 0; i < miniBatchData.size(); i++) {
-                    miniBatchLoss += meanSquaredError(outputs[i], oneHotLabels[i]);
-                }
-                epochLoss += miniBatchLoss;
+    // out-of-core variant: the dataset streams its own shuffled order, so a single worker reads ahead
+    void train(StreamingDataset& data, int epochs, int miniBatchSize, double learningRate) {
+        const size_t numSamples = data.size();
+        const size_t numBatches = (numSamples + miniBatchSize - 1) / miniBatchSize;
+        TrainingState start = takeResumeState();
+        std::unique_ptr<Evaluator> validator = validationData ? std::make_unique<Evaluator>(compile()) : nullptr;
+
+        for (int epoch = static_cast<int>(start.epoch); epoch < epochs; epoch++) {
+            std::cout << "Epoch: " << epoch << "\t";
+            double epochLoss = 0.0;
 
-                // Forward and backward pass for the mini-batch
-                Gradients grad = backward(miniBatchData, outputs, oneHotLabels);
+            data.beginEpoch(mixSeed(shuffleSeed ^ epoch));
 
-                for (size_t i = 0; i < layers.size(); i++) {
-                    layers[i].updateWeightsAndBiases(grad.weightGradients[i], grad.biasGradients[i], learningRate);
+            // a resumed epoch reads past the samples its checkpoint already covered
+            size_t firstBatch = epoch == static_cast<int>(start.epoch) ? std::min<size_t>(start.batchInEpoch, numBatches) : 0;
+            Matrix skipped;
+            int skippedLabel;
+            for (size_t i = 0; i < firstBatch * miniBatchSize && data.next(skipped, skippedLabel); i++) {
+            }
+
+            BatchPrefetcher prefetcher(numBatches - firstBatch, prefetchDepth, 1, [&](size_t batchIndex, MiniBatch& batch) {
+                batch.data.resize(miniBatchSize);
+                batch.targets.resize(miniBatchSize);
+
+                size_t count = 0;
+                while (count < static_cast<size_t>(miniBatchSize) && data.next(batch.data[count], batch.targets[count])) {
+                    if (augmenter) {
+                        // a stream has no stable sample ids, so augmentation keys on the position in the epoch
+                        augmenter->apply(batch.data[count], epoch, (firstBatch + batchIndex) * miniBatchSize + count);
+                    }
+                    count++;
+                }
+                batch.data.resize(count);
+                batch.targets.resize(count);
+            });
+
+            while (const MiniBatch* batch = prefetcher.next()) {
+                if (!batch->data.empty()) {
+                    epochLoss += trainOnBatch(batch->data, batch->targets, learningRate);
                 }
+                maybeCheckpoint(epoch, firstBatch + batch->index + 1, numBatches);
+            }
+
+            std::cout << "Loss: " << (epochLoss / numSamples) << "\tData stall: " << prefetcher.stallSeconds() * 1000.0 << " ms";
+            printValidation(validator);
+        }
+
+        if (checkpointer) {
+            checkpointer->flush();
+        }
+    }
+
+    // one SGD step, returns the summed loss of the mini-batch
+    double trainOnBatch(const std::vector<Matrix>& miniBatchData, const std::vector<int>& miniBatchTargets, double learningRate) {
+        // forward pass for the mini-batch
+        std::vector<Matrix> outputs = computeOutputs(miniBatchData);
+
+        // encode target vector into a 32 x 1 vector of 10 x 1 matrices
+        std::vector<Matrix> oneHotLabels = createOneHotTargets(miniBatchTargets, 10);
+
+        // calc mse for mini-batch
+        double miniBatchLoss = 0.0;
+        for (size_t i = 0; i < miniBatchData.size(); i++) {
+            miniBatchLoss += meanSquaredError(outputs[i], oneHotLabels[i]);
+        }
+
+        // Forward and backward pass for the mini-batch
+        Gradients grad = backward(miniBatchData, outputs, oneHotLabels);
+
+        for (size_t i = 0; i < layers.size(); i++) {
+            layers[i].updateWeightsAndBiases(grad.weightGradients[i], grad.biasGradients[i], learningRate);
+        }
+        for (size_t h = 0; h < exitHeads.size(); h++) {
+            exitHeads[h].classifier.updateWeightsAndBiases(grad.headWeightGradients[h], grad.headBiasGradients[h], learningRate);
+        }
+        step++;
+        weightsGeneration = PredictionCache::newGeneration();
+
+        return miniBatchLoss;
+    }
+
+    // how many batches are prepared ahead of training, and by how many threads
+    void setPrefetch(size_t depth, size_t workers) noexcept {
+        prefetchDepth = depth;
+        prefetchWorkers = workers;
+    }
+
+    // random distortions applied to every training sample on the prefetch workers, nullptr turns it off
+    void setAugmenter(std::shared_ptr<const Augmenter> aug) noexcept {
+        augmenter = std::move(aug);
+    }
+
+    // evaluated after every epoch of train() and printed next to the training loss, nullptr turns it off
+    void setValidationData(std::shared_ptr<const Dataset> data) noexcept {
+        validationData = std::move(data);
+    }
+
+    // write a checkpoint to path every everySteps mini-batches and/or everySeconds seconds while training
+    // an empty path turns checkpointing off. Checkpoints hold the base layers only, not exit heads,
+    // so a network with exit heads attached cannot checkpoint.
+    void setCheckpointing(const std::string& path, size_t everySteps, double everySeconds = 0.0) {
+        checkpointer.reset();
+        if (!path.empty()) {
+            if (!exitHeads.empty()) {
+                throw std::runtime_error("Cannot checkpoint a network with exit heads, they are not stored in checkpoints.");
             }
+            checkpointer = std::make_shared<Checkpointer>(path, everySteps, everySeconds);
+        }
+    }
 
-            // Output epoch loss
-            std::cout << "Loss: " << (epochLoss / Xtrain.size()) << std::endl;        
+    // loads a checkpoint's weights and training position, the next train() call picks up where it left off.
+    // A checkpoint inside the first epoch replays its order only if the dataset is again still loading, or
+    // again fully loaded, when train() starts (see Dataset::loadsInOrder); waiting for the full load first
+    // with MNISTLoader::waitForItems makes that hold on both runs. Checkpoints carry no exit heads, so a
+    // network with heads attached cannot resume.
+    void resumeFrom(const std::string& path) {
+        if (!exitHeads.empty()) {
+            throw std::runtime_error("Cannot resume a network with exit heads, they are not stored in checkpoints.");
         }
+        layers = readModel(path);
+        weightsGeneration = PredictionCache::newGeneration();
+        resumeState = readTrainingState(path);
+        shuffleSeed = resumeState.shuffleSeed;
+        step = resumeState.step;
+        resumePending = true;
+    }
+
+    // seed for the per-epoch shuffle, fixed seeds make runs reproducible
+    void setShuffleSeed(uint64_t seed) noexcept {
+        shuffleSeed = seed;
+    }
+
+    uint64_t getStep() const noexcept {
+        return step;
     }
 
     Gradients backward(const std::vector<Matrix>& inputs, const std::vector<Matrix>& outputs, const std::vector<Matrix>& targets) {
@@ -103,6 +399,8 @@ public:
         std::vector<Matrix> delta(numLayers);
         std::vector<Matrix> weightGradients(numLayers);
         std::vector<Matrix> biasGradients(numLayers);
+        std::vector<Matrix> headWeightGradients(exitHeads.size());
+        std::vector<Matrix> headBiasGradients(exitHeads.size());
 
         // compute delta for last layer
         // Compute delta for the last layer
@@ -114,7 +412,20 @@ public:
 
 
         for (int i = numLayers - 2; i >= 0; i--) {
-            delta[i] = (layers[i + 1].weights.T() * delta[i + 1]).elementwiseMult(sigmoidPrime(layers[i].z));  // Shape should be (numNeuronsInCurrentLayer x 1)
+            delta[i] = (layers[i + 1].weights.T() * delta[i + 1]).elementwiseMult(activatePrime(layers[i].z, layers[i].activation));  // Shape should be (numNeuronsInCurrentLayer x 1)
+
+            // an exit head on this layer adds its own error: softmax with cross-entropy gives probabilities - target
+            for (size_t h = 0; h < exitHeads.size(); h++) {
+                if (exitHeads[h].afterLayer != static_cast<size_t>(i)) {
+                    continue;
+                }
+                const Layer& head = exitHeads[h].classifier;
+                const Matrix hidden = layers[i].getOutput();
+                Matrix headDelta = (softmax((head.weights * hidden) + head.biases) - targets.back()) * exitHeads[h].lossWeight;
+                headWeightGradients[h] = headDelta * hidden.T();
+                headBiasGradients[h] = headDelta;
+                delta[i] = delta[i] + (head.weights.T() * headDelta).elementwiseMult(activatePrime(layers[i].z, layers[i].activation));
+            }
 
             if (i > 0) {
                 weightGradients[i] = delta[i] * layers[i - 1].getOutput().T();  // Shape should be (numNeuronsInCurrentLayer x numNeuronsInPreviousLayer)
@@ -126,36 +437,22 @@ public:
             biasGradients[i] = delta[i];  // Shape should be (numNeuronsInCurrentLayer x 1)
         }
 
-        return { weightGradients, biasGradients };
+        return { weightGradients, biasGradients, headWeightGradients, headBiasGradients };
     }
 
-    // Evaluation function
-    double eval(std::vector<Matrix>& testData, std::vector<int>& targets) {
-        int correct = 0;
-
-        // forward pass for the entire test set
-        std::vector<Matrix> outputs = forward(testData);
-
-        for (size_t i = 0; i < outputs.size(); i++) {
-            int predicted = getPrediction(outputs[i]);
-            if (predicted == targets[i]) {
-                correct++;
-            }
-        }
+    // Evaluation function, percentage accuracy of the full network
+    double eval(const std::vector<Matrix>& testData, const std::vector<int>& targets) const {
+        return evaluate(MatrixDataset(testData, targets)).accuracy();
+    }
 
-        return (static_cast<double>(correct) / testData.size()) * 100; // Percentage accuracy
+    // accuracy, loss, confusion matrix and per-class precision/recall, streamed through the compiled
+    // model in chunks on threads (0 = one per core); the cache and exit heads are not used
+    EvaluationReport evaluate(const Dataset& data, size_t threads = 0) const {
+        return Evaluator(compile(), threads).evaluate(data);
     }
 
-    int getPrediction(const Matrix& output) {
-        int maxIdx = 0;
-        double maxValue = output[0][0];
-        for (int i = 1; i < output.numRows(); i++) {
-            if (output[i][0] > maxValue) {
-                maxValue = output[i][0];
-                maxIdx = i;
-            }
-        }
-        return maxIdx;
+    int getPrediction(const Matrix& output) const {
+        return argmax(output.data(), output.numRows() * output.numCols());
     }
 
     // one hot encoding
@@ -205,4 +502,81 @@ public:
 
 private:
     std::vector<Layer> layers; // overall network structure
+
+    size_t prefetchDepth = 4;
+    size_t prefetchWorkers = 2;
+    static constexpr size_t firstEpochWindow = 4096; // samples shuffled together in the first epoch of an in-order dataset
+    std::shared_ptr<const Augmenter> augmenter;
+    std::shared_ptr<const Dataset> validationData;
+
+    uint64_t shuffleSeed;
+    uint64_t step = 0; // mini-batches trained so far
+    std::shared_ptr<Checkpointer> checkpointer;
+    TrainingState resumeState = TrainingState();
+    bool resumePending = false;
+
+    std::vector<ExitHead> exitHeads; // ordered by afterLayer
+    double exitThreshold = 2.0;
+    std::vector<uint64_t> exitCounts = std::vector<uint64_t>(1, 0);
+    uint64_t layersExecuted = 0;
+
+    std::shared_ptr<PredictionCache> predictionCache;
+    uint64_t weightsGeneration = PredictionCache::newGeneration(); // the cache key of the current weights
+    std::vector<uint8_t> cacheKey; // forward() scratch
+    std::vector<float> cachedOutputs;
+
+    // one input through the layers, leaving at the first exit head that is confident enough
+    Matrix forwardOne(const Matrix& input) {
+        Matrix current = input.flatten();
+        size_t head = 0;
+        for (size_t i = 0; i < layers.size(); i++) {
+            layers[i].feedForward(current);
+            current = layers[i].getOutput();
+            if (head < exitHeads.size() && exitHeads[head].afterLayer == i) {
+                if (exitThreshold <= 1.0) {
+                    const Layer& classifier = exitHeads[head].classifier;
+                    Matrix probabilities = softmax((classifier.weights * current) + classifier.biases);
+                    if (probabilities[getPrediction(probabilities)][0] >= exitThreshold) {
+                        exitCounts[head]++;
+                        layersExecuted += i + 1;
+                        return probabilities;
+                    }
+                }
+                head++;
+            }
+        }
+        exitCounts.back()++;
+        layersExecuted += layers.size();
+        return current;
+    }
+
+    // where train() starts, epoch 0 unless resumeFrom() was called
+    TrainingState takeResumeState() {
+        TrainingState start = resumePending ? resumeState : TrainingState();
+        resumePending = false;
+        return start;
+    }
+
+    // ends the epoch's line, with the validation accuracy and loss when a validation set is set
+    void printValidation(const std::unique_ptr<Evaluator>& validator) {
+        if (validator) {
+            validator->setModel(compile());
+            EvaluationReport report = validator->evaluate(*validationData);
+            std::cout << "\tValidation: " << report.accuracy() << "% (loss " << report.loss() << ")";
+        }
+        std::cout << std::endl;
+    }
+
+    // batchesDone counts the current epoch's finished batches, a finished epoch is stored as the start of the next
+    void maybeCheckpoint(int epoch, size_t batchesDone, size_t numBatches) {
+        if (!checkpointer || !checkpointer->due(step)) {
+            return;
+        }
+        TrainingState state = TrainingState();
+        state.epoch = batchesDone == numBatches ? epoch + 1 : epoch;
+        state.batchInEpoch = batchesDone == numBatches ? 0 : batchesDone;
+        state.step = step;
+        state.shuffleSeed = shuffleSeed;
+        checkpointer->snapshot(layers, state);
+    }
 };
\ No newline at end of file
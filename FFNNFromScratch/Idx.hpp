@@ -0,0 +1,227 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include "Inflate.hpp"
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#define FFNN_IDX_SIMD_SWAP 1
+#endif
+
+// IDX is stored in big-endian format, while my system uses little-endian format
+inline uint32_t swap_endian(uint32_t val) {
+	val = ((val << 8) & 0xFF00FF00) | ((val >> 8) & 0x00FF00FF);
+	return (val << 16) | (val >> 16);
+}
+
+// element type byte of the IDX magic (third byte)
+enum class IdxType : uint8_t {
+	uint8 = 0x08,
+	int8 = 0x09,
+	int16 = 0x0B,
+	int32 = 0x0C,
+	float32 = 0x0D,
+	float64 = 0x0E
+};
+
+inline size_t idxTypeSize(IdxType type) {
+	switch (type) {
+	case IdxType::uint8:
+	case IdxType::int8:
+		return 1;
+	case IdxType::int16:
+		return 2;
+	case IdxType::int32:
+	case IdxType::float32:
+		return 4;
+	case IdxType::float64:
+		return 8;
+	}
+	throw std::runtime_error("Unknown IDX type: " + std::to_string(static_cast<int>(type)));
+}
+
+// reverses the byte order of count elements of elemSize bytes each, in place
+inline void byteSwapInPlace(char* data, size_t count, size_t elemSize) {
+	if (elemSize == 1) {
+		return;
+	}
+
+	size_t i = 0;
+#ifdef FFNN_IDX_SIMD_SWAP
+	// shuffle 16 bytes at a time, the mask reverses each element within the lane
+	__m128i mask;
+	if (elemSize == 2) {
+		mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	}
+	else if (elemSize == 4) {
+		mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	}
+	else {
+		mask = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	}
+
+	const size_t perVec = 16 / elemSize;
+	for (; i + perVec <= count; i += perVec) {
+		__m128i* p = reinterpret_cast<__m128i*>(data + i * elemSize);
+		_mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), mask));
+	}
+#endif
+
+	for (; i < count; i++) {
+		std::reverse(data + i * elemSize, data + (i + 1) * elemSize);
+	}
+}
+
+struct IdxHeader {
+	IdxType type = IdxType::uint8;
+	std::vector<uint32_t> dims; // dims[0] is the item count
+
+	size_t numItems() const noexcept {
+		return dims.empty() ? 0 : dims[0];
+	}
+
+	// number of scalars per item (product of every dim after the first)
+	size_t itemSize() const noexcept {
+		size_t size = 1;
+		for (size_t i = 1; i < dims.size(); i++) {
+			size *= dims[i];
+		}
+		return size;
+	}
+
+	size_t itemBytes() const {
+		return itemSize() * idxTypeSize(type);
+	}
+
+	// Shape of an image file's items as rows x cols, anything past the row dimension (e.g. channels)
+	// folded into the columns. Throws unless the file is rank >= 2 with no zero dimension.
+	void imageShape(size_t& rows, size_t& cols) const {
+		if (dims.size() < 2) {
+			throw std::runtime_error("Image file must have at least 2 dimensions, got " + std::to_string(dims.size()));
+		}
+		for (size_t d = 1; d < dims.size(); d++) {
+			if (dims[d] == 0) {
+				throw std::runtime_error("Image dimension " + std::to_string(d) + " is zero.");
+			}
+		}
+		rows = dims[1];
+		cols = itemSize() / rows;
+		if (rows * cols != itemSize()) {
+			throw std::runtime_error("Image dimensions do not fold into " + std::to_string(rows) + " rows of " + std::to_string(itemSize()) + " values.");
+		}
+	}
+
+	// labels are a rank 1 integer column
+	bool isLabelColumn() const noexcept {
+		return dims.size() == 1 && type != IdxType::float32 && type != IdxType::float64;
+	}
+};
+
+// Reads any IDX file (any element type, any rank), raw or gzip-compressed.
+// Items are streamed sequentially, byte-swapped to host order and optionally converted.
+class IdxReader {
+public:
+	explicit IdxReader(const std::string& filename) : stream(openByteStream(filename)) {
+		readHeader();
+	}
+
+	const IdxHeader& header() const noexcept {
+		return hdr;
+	}
+
+	size_t itemsRemaining() const noexcept {
+		return hdr.numItems() - itemsRead;
+	}
+
+	// repositions the reader at item index, only possible on uncompressed files
+	void seekToItem(size_t index) {
+		if (index > hdr.numItems()) {
+			throw std::out_of_range("IDX item index out of range.");
+		}
+		uint64_t headerBytes = 4 + 4 * static_cast<uint64_t>(hdr.dims.size());
+		if (!stream->seek(headerBytes + static_cast<uint64_t>(index) * hdr.itemBytes())) {
+			throw std::runtime_error("IDX stream is not seekable.");
+		}
+		itemsRead = index;
+	}
+
+	// reads up to count items in host byte order into dst (count * itemBytes() bytes), returns items read
+	size_t readRaw(char* dst, size_t count) {
+		count = std::min(count, itemsRemaining());
+		stream->readExact(dst, count * hdr.itemBytes());
+		byteSwapInPlace(dst, count * hdr.itemSize(), idxTypeSize(hdr.type));
+		itemsRead += count;
+		return count;
+	}
+
+	// reads up to count items converted to T (count * itemSize() values), returns items read
+	template <typename T>
+	size_t readItems(T* dst, size_t count) {
+		count = std::min(count, itemsRemaining());
+		const size_t numValues = count * hdr.itemSize();
+		if (hdr.type == IdxType::uint8) {
+			// single bytes need no swap, widen straight from the raw buffer
+			scratch.resize(numValues);
+			readRaw(scratch.data(), count);
+			const uint8_t* src = reinterpret_cast<const uint8_t*>(scratch.data());
+			for (size_t i = 0; i < numValues; i++) {
+				dst[i] = static_cast<T>(src[i]);
+			}
+			return count;
+		}
+
+		scratch.resize(count * hdr.itemBytes());
+		readRaw(scratch.data(), count);
+		switch (hdr.type) {
+		case IdxType::int8:    convert<int8_t>(dst, numValues); break;
+		case IdxType::int16:   convert<int16_t>(dst, numValues); break;
+		case IdxType::int32:   convert<int32_t>(dst, numValues); break;
+		case IdxType::float32: convert<float>(dst, numValues); break;
+		case IdxType::float64: convert<double>(dst, numValues); break;
+		default: break;
+		}
+		return count;
+	}
+
+private:
+	std::unique_ptr<ByteStream> stream;
+	IdxHeader hdr;
+	size_t itemsRead = 0;
+	std::vector<char> scratch;
+
+	void readHeader() {
+		unsigned char magic[4];
+		stream->readExact(reinterpret_cast<char*>(magic), 4);
+		if (magic[0] != 0 || magic[1] != 0) {
+			throw std::runtime_error("Incorrect IDX magic.");
+		}
+
+		hdr.type = static_cast<IdxType>(magic[2]);
+		idxTypeSize(hdr.type); // validates the type byte
+
+		size_t rank = magic[3];
+		if (rank == 0) {
+			throw std::runtime_error("IDX file has no dimensions.");
+		}
+		hdr.dims.resize(rank);
+		for (auto& dim : hdr.dims) {
+			uint32_t val;
+			stream->readExact(reinterpret_cast<char*>(&val), 4);
+			dim = swap_endian(val);
+		}
+	}
+
+	template <typename Src, typename T>
+	void convert(T* dst, size_t numValues) const {
+		for (size_t i = 0; i < numValues; i++) {
+			Src val;
+			std::memcpy(&val, scratch.data() + i * sizeof(Src), sizeof(Src));
+			dst[i] = static_cast<T>(val);
+		}
+	}
+};
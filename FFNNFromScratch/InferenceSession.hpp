@@ -0,0 +1,247 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "Layer.hpp"
+#include "ActivationFunction.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Immutable inference plan compiled from a network's layers: float weights in one padded row-major
+// block per layer, biases and activations. It is never written after construction, so any number of
+// InferenceSessions on any threads can share one plan.
+class CompiledModel {
+public:
+	struct LayerPlan {
+		size_t rows;
+		size_t cols;
+		size_t stride; // row length rounded up to 8 floats, the padding is zero
+		Activations activation;
+		std::vector<float> weights; // rows x stride
+		std::vector<float> biases;
+	};
+
+	explicit CompiledModel(const std::vector<Layer>& source) {
+		if (source.empty()) {
+			throw std::invalid_argument("Cannot compile a network without layers.");
+		}
+
+		for (size_t l = 0; l < source.size(); l++) {
+			const Layer& layer = source[l];
+			if (l > 0 && layer.weights.numCols() != source[l - 1].weights.numRows()) {
+				throw std::invalid_argument("Layer " + std::to_string(l) + " input size does not match the previous layer.");
+			}
+
+			LayerPlan plan;
+			plan.rows = layer.weights.numRows();
+			plan.cols = layer.weights.numCols();
+			plan.stride = (plan.cols + 7) & ~size_t(7);
+			plan.activation = layer.activation;
+			plan.weights.assign(plan.rows * plan.stride, 0.0f);
+			plan.biases.resize(plan.rows);
+			for (size_t r = 0; r < plan.rows; r++) {
+				const double* row = layer.weights[r];
+				for (size_t c = 0; c < plan.cols; c++) {
+					plan.weights[r * plan.stride + c] = static_cast<float>(row[c]);
+				}
+				plan.biases[r] = static_cast<float>(layer.biases[r][0]);
+			}
+			maxWidth = std::max(maxWidth, std::max(plan.stride, (plan.rows + 7) & ~size_t(7)));
+			layers.push_back(std::move(plan));
+		}
+	}
+
+	size_t numInputs() const noexcept {
+		return layers.front().cols;
+	}
+
+	size_t numOutputs() const noexcept {
+		return layers.back().rows;
+	}
+
+	// widest activation vector any layer reads or writes, padding included
+	size_t bufferSize() const noexcept {
+		return maxWidth;
+	}
+
+	const std::vector<LayerPlan>& getLayers() const noexcept {
+		return layers;
+	}
+
+private:
+	std::vector<LayerPlan> layers;
+	size_t maxWidth = 0;
+};
+
+// Per-thread execution state for a CompiledModel: two activation buffers sized once for the widest
+// layer and batchTile samples, which the layers ping-pong between. run() and runBatch() allocate
+// nothing and never touch the model.
+class InferenceSession {
+public:
+	// samples runBatch() pushes through each layer together, so a weight row fetched into cache is
+	// reused for all of them instead of once per sample
+	static constexpr size_t batchTile = 16;
+
+	explicit InferenceSession(std::shared_ptr<const CompiledModel> model) :
+		model(std::move(model)), ping(batchTile * this->model->bufferSize(), 0.0f), pong(batchTile * this->model->bufferSize(), 0.0f)
+	{
+	}
+
+	const CompiledModel& getModel() const noexcept {
+		return *model;
+	}
+
+	// one sample: numInputs() values in, numOutputs() values out
+	void run(std::span<const float> input, std::span<float> output) {
+		if (input.size() != model->numInputs() || output.size() != model->numOutputs()) {
+			throw std::invalid_argument("Input or output span does not match the compiled model.");
+		}
+		runTile(input.data(), output.data(), 1);
+	}
+
+	// count samples stored back to back, computed as one matrix product per layer and tile
+	void runBatch(std::span<const float> inputs, std::span<float> outputs, size_t count) {
+		const size_t numInputs = model->numInputs();
+		const size_t numOutputs = model->numOutputs();
+		if (inputs.size() != count * numInputs || outputs.size() != count * numOutputs) {
+			throw std::invalid_argument("Batch spans do not match the compiled model.");
+		}
+		for (size_t first = 0; first < count; first += batchTile) {
+			runTile(inputs.data() + first * numInputs, outputs.data() + first * numOutputs, std::min(batchTile, count - first));
+		}
+	}
+
+	// index of the largest output for one sample
+	int classify(std::span<const float> input, std::span<float> output) {
+		run(input, output);
+		return static_cast<int>(std::max_element(output.begin(), output.end()) - output.begin());
+	}
+
+	// out = activation(W * in + b) for count samples, sample s reads layer.stride floats at in + s * inStride
+	// and writes layer.rows at out + s * outStride. Four rows by two samples per pass under AVX2: each
+	// weight load feeds two dot products and each input load four.
+	static void runLayer(const CompiledModel::LayerPlan& layer, const float* in, size_t inStride, float* out, size_t outStride, size_t count) {
+		const size_t stride = layer.stride;
+		size_t r = 0;
+
+#ifdef __AVX2__
+		for (; r + 4 <= layer.rows; r += 4) {
+			const float* w = layer.weights.data() + r * stride;
+			size_t s = 0;
+			for (; s + 2 <= count; s += 2) {
+				const float* x0 = in + s * inStride;
+				const float* x1 = x0 + inStride;
+				__m256 a0 = _mm256_setzero_ps(), a1 = a0, a2 = a0, a3 = a0;
+				__m256 b0 = a0, b1 = a0, b2 = a0, b3 = a0;
+				for (size_t k = 0; k < stride; k += 8) {
+					__m256 u = _mm256_loadu_ps(x0 + k);
+					__m256 v = _mm256_loadu_ps(x1 + k);
+					__m256 w0 = _mm256_loadu_ps(w + k);
+					__m256 w1 = _mm256_loadu_ps(w + stride + k);
+					__m256 w2 = _mm256_loadu_ps(w + 2 * stride + k);
+					__m256 w3 = _mm256_loadu_ps(w + 3 * stride + k);
+					a0 = _mm256_add_ps(a0, _mm256_mul_ps(u, w0));
+					a1 = _mm256_add_ps(a1, _mm256_mul_ps(u, w1));
+					a2 = _mm256_add_ps(a2, _mm256_mul_ps(u, w2));
+					a3 = _mm256_add_ps(a3, _mm256_mul_ps(u, w3));
+					b0 = _mm256_add_ps(b0, _mm256_mul_ps(v, w0));
+					b1 = _mm256_add_ps(b1, _mm256_mul_ps(v, w1));
+					b2 = _mm256_add_ps(b2, _mm256_mul_ps(v, w2));
+					b3 = _mm256_add_ps(b3, _mm256_mul_ps(v, w3));
+				}
+				finishRows(layer, r, out + s * outStride, a0, a1, a2, a3);
+				finishRows(layer, r, out + (s + 1) * outStride, b0, b1, b2, b3);
+			}
+			if (s < count) {
+				const float* x = in + s * inStride;
+				__m256 acc0 = _mm256_setzero_ps(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+				for (size_t k = 0; k < stride; k += 8) {
+					__m256 u = _mm256_loadu_ps(x + k);
+					acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(u, _mm256_loadu_ps(w + k)));
+					acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(u, _mm256_loadu_ps(w + stride + k)));
+					acc2 = _mm256_add_ps(acc2, _mm256_mul_ps(u, _mm256_loadu_ps(w + 2 * stride + k)));
+					acc3 = _mm256_add_ps(acc3, _mm256_mul_ps(u, _mm256_loadu_ps(w + 3 * stride + k)));
+				}
+				finishRows(layer, r, out + s * outStride, acc0, acc1, acc2, acc3);
+			}
+		}
+#endif
+
+		// eight partial sums over the zero-padded stride, which the compiler can keep in one vector register
+		for (; r < layer.rows; r++) {
+			const float* w = layer.weights.data() + r * stride;
+			for (size_t s = 0; s < count; s++) {
+				const float* x = in + s * inStride;
+				float acc[8] = {};
+				for (size_t k = 0; k < stride; k += 8) {
+					for (size_t j = 0; j < 8; j++) {
+						acc[j] += w[k + j] * x[k + j];
+					}
+				}
+				float z = ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+				out[s * outStride + r] = activateValue(z + layer.biases[r], layer.activation);
+			}
+		}
+	}
+
+private:
+	std::shared_ptr<const CompiledModel> model;
+	std::vector<float> ping;
+	std::vector<float> pong;
+
+	static float activateValue(float z, Activations activation) {
+		return activation == Activations::relu ? std::max(0.0f, z) : 1.0f / (1.0f + std::exp(-z));
+	}
+
+	// up to batchTile samples through every layer, each sample padded to the reading layer's stride
+	void runTile(const float* input, float* output, size_t count) {
+		const auto& layers = model->getLayers();
+		const size_t numInputs = model->numInputs();
+		const size_t firstStride = layers.front().stride;
+		for (size_t s = 0; s < count; s++) {
+			std::copy(input + s * numInputs, input + (s + 1) * numInputs, ping.begin() + s * firstStride);
+			std::fill(ping.begin() + s * firstStride + numInputs, ping.begin() + (s + 1) * firstStride, 0.0f);
+		}
+
+		float* in = ping.data();
+		float* out = pong.data();
+		for (size_t l = 0; l < layers.size(); l++) {
+			const auto& layer = layers[l];
+			if (l + 1 == layers.size()) {
+				runLayer(layer, in, layer.stride, output, layer.rows, count);
+				break;
+			}
+
+			const size_t nextStride = layers[l + 1].stride;
+			runLayer(layer, in, layer.stride, out, nextStride, count);
+			// zero the padding the next layer's dot products read
+			for (size_t s = 0; s < count; s++) {
+				std::fill(out + s * nextStride + layer.rows, out + (s + 1) * nextStride, 0.0f);
+			}
+			std::swap(in, out);
+		}
+	}
+
+#ifdef __AVX2__
+	static void finishRows(const CompiledModel::LayerPlan& layer, size_t r, float* out, __m256 acc0, __m256 acc1, __m256 acc2, __m256 acc3) {
+		out[r] = activateValue(horizontalSum(acc0) + layer.biases[r], layer.activation);
+		out[r + 1] = activateValue(horizontalSum(acc1) + layer.biases[r + 1], layer.activation);
+		out[r + 2] = activateValue(horizontalSum(acc2) + layer.biases[r + 2], layer.activation);
+		out[r + 3] = activateValue(horizontalSum(acc3) + layer.biases[r + 3], layer.activation);
+	}
+#endif
+
+#ifdef __AVX2__
+	static float horizontalSum(__m256 v) {
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_movehdup_ps(s));
+		return _mm_cvtss_f32(s);
+	}
+#endif
+};
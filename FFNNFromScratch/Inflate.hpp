@@ -0,0 +1,486 @@
+#pragma once
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include "Checksum.hpp"
+
+// sequential byte source for the dataset loaders, either a raw file or a gzip stream
+class ByteStream {
+public:
+	virtual ~ByteStream() = default;
+
+	// reads up to n bytes, returns how many were read (0 only at the end of the stream)
+	virtual size_t read(char* dst, size_t n) = 0;
+
+	// jumps to an absolute byte offset, returns false when the stream can't seek (compressed input)
+	virtual bool seek(uint64_t /*offset*/) {
+		return false;
+	}
+
+	// reads exactly n bytes or throws
+	void readExact(char* dst, size_t n) {
+		size_t total = 0;
+		while (total < n) {
+			size_t got = read(dst + total, n - total);
+			if (got == 0) {
+				throw std::runtime_error("Unexpected end of stream.");
+			}
+			total += got;
+		}
+	}
+};
+
+class FileByteStream : public ByteStream {
+public:
+	explicit FileByteStream(const std::string& filename) : file(filename, std::ios::in | std::ios::binary) {
+		if (!file.is_open()) {
+			throw std::runtime_error("Unable to open file: " + filename);
+		}
+	}
+
+	size_t read(char* dst, size_t n) override {
+		file.read(dst, n);
+		return static_cast<size_t>(file.gcount());
+	}
+
+	bool seek(uint64_t offset) override {
+		file.clear();
+		file.seekg(static_cast<std::streamoff>(offset));
+		return static_cast<bool>(file);
+	}
+
+private:
+	std::ifstream file;
+};
+
+// canonical huffman decoding table for one deflate alphabet
+// codes up to fastBits long are resolved with a single lookup, longer ones walk the canonical counts
+struct HuffmanTable {
+	static const int maxBits = 15;
+	static const int fastBits = 10;
+
+	std::vector<uint16_t> fast; // (symbol << 4) | code length, 0 when the code is longer than fastBits
+	uint16_t counts[maxBits + 1] = {};
+	std::vector<uint16_t> symbols; // symbols ordered by code
+
+	void build(const uint8_t* lengths, size_t numSymbols) {
+		std::fill(counts, counts + maxBits + 1, 0);
+		for (size_t s = 0; s < numSymbols; s++) {
+			counts[lengths[s]]++;
+		}
+		counts[0] = 0;
+
+		// reject over-subscribed codes, incomplete ones are legal (e.g. a single distance code)
+		int left = 1;
+		for (int len = 1; len <= maxBits; len++) {
+			left = (left << 1) - counts[len];
+			if (left < 0) {
+				throw std::runtime_error("Invalid deflate stream: over-subscribed huffman code.");
+			}
+		}
+
+		uint16_t offsets[maxBits + 2] = {};
+		for (int len = 1; len <= maxBits; len++) {
+			offsets[len + 1] = offsets[len] + counts[len];
+		}
+
+		symbols.assign(numSymbols, 0);
+		for (size_t s = 0; s < numSymbols; s++) {
+			if (lengths[s] != 0) {
+				symbols[offsets[lengths[s]]++] = static_cast<uint16_t>(s);
+			}
+		}
+
+		// walk the canonical codes in order and fill the fast table with their bit-reversed form
+		fast.assign(size_t(1) << fastBits, 0);
+		uint32_t code = 0;
+		size_t index = 0;
+		for (int len = 1; len <= maxBits; len++) {
+			for (int k = 0; k < counts[len]; k++, index++, code++) {
+				if (len > fastBits) {
+					continue;
+				}
+				uint32_t reversed = 0;
+				for (int b = 0; b < len; b++) {
+					reversed |= ((code >> b) & 1u) << (len - 1 - b);
+				}
+				uint16_t entry = static_cast<uint16_t>((symbols[index] << 4) | len);
+				for (uint32_t slot = reversed; slot < fast.size(); slot += (1u << len)) {
+					fast[slot] = entry;
+				}
+			}
+			code <<= 1;
+		}
+	}
+};
+
+// streaming gzip (RFC 1952) reader with a self-contained inflate (RFC 1951)
+// decompression happens lazily inside read(), so memory use is the 32 KB window plus the input buffer
+class GzipByteStream : public ByteStream {
+public:
+	explicit GzipByteStream(const std::string& filename) :
+		file(filename, std::ios::in | std::ios::binary), inBuf(1 << 16), window(windowSize)
+	{
+		if (!file.is_open()) {
+			throw std::runtime_error("Unable to open file: " + filename);
+		}
+		readGzipHeader();
+	}
+
+	size_t read(char* dst, size_t n) override {
+		uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+		size_t produced = 0;
+
+		while (produced < n) {
+			// finish any pending back-reference first
+			if (copyRemaining > 0) {
+				size_t count = std::min(copyRemaining, n - produced);
+				for (size_t i = 0; i < count; i++) {
+					emit(out, produced, window[(windowPos - copyDistance) & windowMask]);
+				}
+				copyRemaining -= count;
+				continue;
+			}
+
+			if (state == State::BlockHeader) {
+				if (finalBlock) {
+					readGzipTrailer(out, produced);
+					state = State::Done;
+				}
+				else {
+					readBlockHeader();
+				}
+			}
+			else if (state == State::Stored) {
+				if (storedRemaining == 0) {
+					state = State::BlockHeader;
+					continue;
+				}
+				emit(out, produced, static_cast<uint8_t>(getBits(8)));
+				storedRemaining--;
+			}
+			else if (state == State::Huffman) {
+				decodeSymbol(out, produced);
+			}
+			else {
+				break; // State::Done
+			}
+		}
+
+		crc = crc32Update(crc, out + crcPending, produced - crcPending);
+		crcPending = 0;
+		return produced;
+	}
+
+private:
+	enum class State { BlockHeader, Stored, Huffman, Done };
+
+	static const size_t windowSize = 1 << 15;
+	static const size_t windowMask = windowSize - 1;
+
+	std::ifstream file;
+	std::vector<uint8_t> inBuf;
+	size_t inPos = 0;
+	size_t inLen = 0;
+	size_t fakeBytes = 0; // zero bytes fed to the bit buffer past the end of the file
+
+	uint64_t bitBuf = 0;
+	int bitCount = 0;
+
+	std::vector<uint8_t> window; // last 32 KB of output for back-references
+	size_t windowPos = 0;
+	uint64_t totalOut = 0;
+
+	State state = State::BlockHeader;
+	bool finalBlock = false;
+	size_t storedRemaining = 0;
+	size_t copyRemaining = 0;
+	size_t copyDistance = 0;
+
+	HuffmanTable litLen;
+	HuffmanTable dist;
+
+	uint32_t crc = 0;
+	size_t crcPending = 0; // bytes of the current output already covered by the crc
+
+	void emit(uint8_t* out, size_t& produced, uint8_t byte) {
+		out[produced++] = byte;
+		window[windowPos++ & windowMask] = byte;
+		totalOut++;
+	}
+
+	uint8_t nextByte() {
+		if (inPos == inLen) {
+			file.read(reinterpret_cast<char*>(inBuf.data()), inBuf.size());
+			inLen = static_cast<size_t>(file.gcount());
+			inPos = 0;
+			if (inLen == 0) {
+				// let the bit buffer run ahead of the file, but not past anything we actually consume
+				if (++fakeBytes > 8) {
+					throw std::runtime_error("Invalid gzip stream: unexpected end of file.");
+				}
+				return 0;
+			}
+		}
+		return inBuf[inPos++];
+	}
+
+	void refill() {
+		while (bitCount <= 56) {
+			bitBuf |= static_cast<uint64_t>(nextByte()) << bitCount;
+			bitCount += 8;
+		}
+	}
+
+	uint32_t getBits(int count) {
+		if (count == 0) {
+			return 0;
+		}
+		if (bitCount < count) {
+			refill();
+		}
+		uint32_t val = static_cast<uint32_t>(bitBuf & ((uint64_t(1) << count) - 1));
+		bitBuf >>= count;
+		bitCount -= count;
+		return val;
+	}
+
+	void alignToByte() {
+		getBits(bitCount % 8);
+	}
+
+	int decode(const HuffmanTable& table) {
+		if (bitCount < HuffmanTable::maxBits) {
+			refill();
+		}
+
+		uint16_t entry = table.fast[bitBuf & ((1u << HuffmanTable::fastBits) - 1)];
+		if (entry != 0) {
+			int len = entry & 0xF;
+			bitBuf >>= len;
+			bitCount -= len;
+			return entry >> 4;
+		}
+
+		// slow path for long codes
+		int code = 0, first = 0, index = 0;
+		for (int len = 1; len <= HuffmanTable::maxBits; len++) {
+			code |= static_cast<int>((bitBuf >> (len - 1)) & 1);
+			int count = table.counts[len];
+			if (code - first < count) {
+				bitBuf >>= len;
+				bitCount -= len;
+				return table.symbols[index + (code - first)];
+			}
+			index += count;
+			first = (first + count) << 1;
+			code <<= 1;
+		}
+		throw std::runtime_error("Invalid deflate stream: bad huffman code.");
+	}
+
+	void decodeSymbol(uint8_t* out, size_t& produced) {
+		static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+			35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+			3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const uint16_t distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+			257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const uint8_t distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+			7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+		int symbol = decode(litLen);
+		if (symbol < 256) {
+			emit(out, produced, static_cast<uint8_t>(symbol));
+			return;
+		}
+		if (symbol == 256) {
+			state = State::BlockHeader;
+			return;
+		}
+
+		symbol -= 257;
+		if (symbol >= 29) {
+			throw std::runtime_error("Invalid deflate stream: bad length symbol.");
+		}
+		size_t length = lengthBase[symbol] + getBits(lengthExtra[symbol]);
+
+		int distSymbol = decode(dist);
+		if (distSymbol >= 30) {
+			throw std::runtime_error("Invalid deflate stream: bad distance symbol.");
+		}
+		size_t distance = distBase[distSymbol] + getBits(distExtra[distSymbol]);
+		if (distance > totalOut || distance > windowSize) {
+			throw std::runtime_error("Invalid deflate stream: distance too far back.");
+		}
+
+		copyRemaining = length;
+		copyDistance = distance;
+	}
+
+	void readBlockHeader() {
+		finalBlock = getBits(1) == 1;
+		uint32_t type = getBits(2);
+
+		if (type == 0) {
+			alignToByte();
+			uint32_t len = getBits(16);
+			uint32_t nlen = getBits(16);
+			if ((len ^ 0xFFFF) != nlen) {
+				throw std::runtime_error("Invalid deflate stream: stored block length mismatch.");
+			}
+			storedRemaining = len;
+			state = State::Stored;
+		}
+		else if (type == 1) {
+			buildFixedTables();
+			state = State::Huffman;
+		}
+		else if (type == 2) {
+			buildDynamicTables();
+			state = State::Huffman;
+		}
+		else {
+			throw std::runtime_error("Invalid deflate stream: reserved block type.");
+		}
+	}
+
+	void buildFixedTables() {
+		uint8_t lengths[288 + 30];
+		std::fill(lengths, lengths + 144, 8);
+		std::fill(lengths + 144, lengths + 256, 9);
+		std::fill(lengths + 256, lengths + 280, 7);
+		std::fill(lengths + 280, lengths + 288, 8);
+		std::fill(lengths + 288, lengths + 318, 5);
+		litLen.build(lengths, 288);
+		dist.build(lengths + 288, 30);
+	}
+
+	void buildDynamicTables() {
+		static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+		size_t hlit = getBits(5) + 257;
+		size_t hdist = getBits(5) + 1;
+		size_t hclen = getBits(4) + 4;
+
+		uint8_t codeLengths[19] = {};
+		for (size_t i = 0; i < hclen; i++) {
+			codeLengths[order[i]] = static_cast<uint8_t>(getBits(3));
+		}
+		HuffmanTable lengthTable;
+		lengthTable.build(codeLengths, 19);
+
+		uint8_t lengths[286 + 30] = {};
+		size_t i = 0;
+		while (i < hlit + hdist) {
+			int symbol = decode(lengthTable);
+			if (symbol < 16) {
+				lengths[i++] = static_cast<uint8_t>(symbol);
+				continue;
+			}
+
+			uint8_t repeatVal = 0;
+			size_t repeat = 0;
+			if (symbol == 16) {
+				if (i == 0) {
+					throw std::runtime_error("Invalid deflate stream: repeat with no previous length.");
+				}
+				repeatVal = lengths[i - 1];
+				repeat = 3 + getBits(2);
+			}
+			else if (symbol == 17) {
+				repeat = 3 + getBits(3);
+			}
+			else {
+				repeat = 11 + getBits(7);
+			}
+
+			if (i + repeat > hlit + hdist) {
+				throw std::runtime_error("Invalid deflate stream: too many code lengths.");
+			}
+			std::fill(lengths + i, lengths + i + repeat, repeatVal);
+			i += repeat;
+		}
+
+		if (lengths[256] == 0) {
+			throw std::runtime_error("Invalid deflate stream: missing end-of-block code.");
+		}
+		litLen.build(lengths, hlit);
+		dist.build(lengths + hlit, hdist);
+	}
+
+	void readGzipHeader() {
+		uint8_t header[10];
+		for (auto& b : header) {
+			b = static_cast<uint8_t>(getBits(8));
+		}
+		if (header[0] != 0x1F || header[1] != 0x8B) {
+			throw std::runtime_error("Not a gzip file.");
+		}
+		if (header[2] != 8) {
+			throw std::runtime_error("Unsupported gzip compression method: " + std::to_string(header[2]));
+		}
+
+		uint8_t flags = header[3];
+		if (flags & 0x04) { // FEXTRA
+			uint32_t extraLen = getBits(16);
+			for (uint32_t i = 0; i < extraLen; i++) {
+				getBits(8);
+			}
+		}
+		if (flags & 0x08) { // FNAME
+			while (getBits(8) != 0) {}
+		}
+		if (flags & 0x10) { // FCOMMENT
+			while (getBits(8) != 0) {}
+		}
+		if (flags & 0x02) { // FHCRC
+			getBits(16);
+		}
+	}
+
+	void readGzipTrailer(const uint8_t* out, size_t produced) {
+		// fold everything produced so far into the crc before comparing
+		crc = crc32Update(crc, out + crcPending, produced - crcPending);
+		crcPending = produced;
+
+		alignToByte();
+		uint32_t expectedCrc = getBits(16);
+		expectedCrc |= getBits(16) << 16;
+		uint32_t expectedSize = getBits(16);
+		expectedSize |= getBits(16) << 16;
+
+		if (fakeBytes > static_cast<size_t>(bitCount / 8)) {
+			throw std::runtime_error("Invalid gzip stream: truncated trailer.");
+		}
+		if (expectedCrc != crc) {
+			throw std::runtime_error("Invalid gzip stream: CRC mismatch.");
+		}
+		if (expectedSize != static_cast<uint32_t>(totalOut)) {
+			throw std::runtime_error("Invalid gzip stream: size mismatch.");
+		}
+	}
+};
+
+inline bool isGzipFile(const std::string& filename) {
+	std::ifstream probe(filename, std::ios::in | std::ios::binary);
+	if (!probe.is_open()) {
+		throw std::runtime_error("Unable to open file: " + filename);
+	}
+
+	unsigned char magic[2] = {};
+	probe.read(reinterpret_cast<char*>(magic), 2);
+	return probe.gcount() == 2 && magic[0] == 0x1F && magic[1] == 0x8B;
+}
+
+// opens a file for sequential reading, transparently inflating it when it starts with the gzip magic
+inline std::unique_ptr<ByteStream> openByteStream(const std::string& filename) {
+	if (isGzipFile(filename)) {
+		return std::unique_ptr<ByteStream>(new GzipByteStream(filename));
+	}
+	return std::unique_ptr<ByteStream>(new FileByteStream(filename));
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+
+// Times runOne(i) for i in [0, count) one call at a time and prints the mean and median per call,
+// name left-aligned in a column of nameWidth characters. Prints nothing measured for count == 0.
+template <typename Fn>
+void printCallLatency(const char* name, int nameWidth, size_t count, Fn&& runOne) {
+	if (count == 0) {
+		std::printf("%-*s no samples\n", nameWidth, name);
+		return;
+	}
+
+	std::vector<double> nanoseconds(count);
+	for (size_t i = 0; i < count; i++) {
+		auto start = std::chrono::steady_clock::now();
+		runOne(i);
+		nanoseconds[i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+	double mean = 0.0;
+	for (double ns : nanoseconds) {
+		mean += ns / count;
+	}
+	std::nth_element(nanoseconds.begin(), nanoseconds.begin() + count / 2, nanoseconds.end());
+	std::printf("%-*s mean %9.0f ns   median %9.0f ns\n", nameWidth, name, mean, nanoseconds[count / 2]);
+}
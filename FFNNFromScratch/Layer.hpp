@@ -14,8 +14,10 @@ public:
 
 	Matrix activation_output; // activated z
 
-	Layer(size_t numNeurons, size_t numInputsPerNeuron) :
-		weights(numNeurons, numInputsPerNeuron), biases(numNeurons, 1)
+	Activations activation; // nonlinearity applied to z
+
+	Layer(size_t numNeurons, size_t numInputsPerNeuron, Activations activation = Activations::sigmoid) :
+		weights(numNeurons, numInputsPerNeuron), biases(numNeurons, 1), activation(activation)
 	{
 
 		// seed for random number generator
@@ -35,9 +37,15 @@ public:
 		}
 	}
 
+	// layer with known parameters, e.g. read back from a model file
+	Layer(Matrix weights, Matrix biases, Activations activation) :
+		weights(std::move(weights)), biases(std::move(biases)), activation(activation)
+	{
+	}
+
 	void feedForward(const Matrix& inputs) {
 		z = (weights * inputs) + biases; // dont forget order matters with mat mult
-		activation_output = sigmoid(z);
+		activation_output = activate(z, activation);
 	}
 
 	void updateWeightsAndBiases(const Matrix& weightGradient, const Matrix& biasGradient, double learningRate) {
@@ -2,99 +2,170 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <memory>
 #include "Matrix.hpp"
 #include "Utils.hpp"
-
-// MNIST is stored in big-endian format, while my system uses little-endian format
-uint32_t swap_endian(uint32_t val) {
-	val = ((val << 8) & 0xFF00FF00) | ((val >> 8) & 0x00FF00FF);
-	return (val << 16) | (val >> 16);
-}
-
-class MNISTLoader {
+#include "Idx.hpp"
+#include "DataPipeline.hpp"
+
+// Loads an image/label IDX pair (MNIST, Fashion-MNIST, EMNIST or exported feature tensors),
+// either raw or gzip-compressed. uint8 images are normalized to [0, 1], other types are kept as is.
+// Headers are parsed up front; the pixels are decoded on a background thread so the caller
+// can set up (or start on the first items, see waitForItems) while the rest is still inflating.
+class MNISTLoader : public Dataset {
 public:
 	MNISTLoader(const std::string& image_filename, const std::string& label_filename) {
-		load_mnist(image_filename, label_filename);
+		open_mnist(image_filename, label_filename);
+		loader = std::thread(&MNISTLoader::load_mnist, this);
+	}
+
+	~MNISTLoader() {
+		if (loader.joinable()) {
+			loader.join();
+		}
 	}
 
-	std::vector<Matrix> getImages() const {
+	MNISTLoader(const MNISTLoader&) = delete;
+	MNISTLoader& operator=(const MNISTLoader&) = delete;
+
+	const std::vector<Matrix>& getImages() {
+		waitForItems(num_items);
 		return images;
 	}
 
-	std::vector<int> getLabels() const {
+	const std::vector<int>& getLabels() {
+		waitForItems(num_items);
 		return labels;
 	}
 
+	// Dataset interface, lets FFNN::train read straight from the loader without copying the set
+	size_t size() const override {
+		return num_items;
+	}
+
+	void getSample(size_t index, Matrix& out) const override {
+		waitForItems(index + 1);
+		out = images[index];
+	}
+
+	int getLabel(size_t index) const override {
+		waitForItems(index + 1);
+		return labels[index];
+	}
+
+	// the background thread decodes in file order
+	bool loadsInOrder() const override {
+		return itemsLoaded() < num_items;
+	}
+
+	size_t itemsLoaded() const {
+		std::lock_guard<std::mutex> lock(progress_mutex);
+		return items_loaded;
+	}
+
+	// blocks until the first n items are decoded, rethrowing any error from the loader thread
+	void waitForItems(size_t n) const {
+		std::unique_lock<std::mutex> lock(progress_mutex);
+		progress.wait(lock, [&] { return items_loaded >= std::min<size_t>(n, num_items) || load_error; });
+		if (load_error) {
+			std::rethrow_exception(load_error);
+		}
+	}
+
 private:
-	std::ifstream image_file;
-	std::ifstream label_file;
+	std::unique_ptr<IdxReader> image_file;
+	std::unique_ptr<IdxReader> label_file;
 	uint32_t num_items;
 	uint32_t num_labels;
-	uint32_t rows;
-	uint32_t cols;
-	char label;
+	size_t rows;
+	size_t cols;
+	double pixel_scale;
 
 	std::vector<Matrix> images; // store images as custom matrix objects
 	std::vector<int> labels; // store labels in vec of ints for FFNN model param
 
-	void load_mnist(const std::string& image_filename, const std::string& label_filename) {
-		// Open files
-		image_file.open(image_filename, std::ios::in | std::ios::binary);
-		label_file.open(label_filename, std::ios::in | std::ios::binary);
-
-		// Read the magic and the meta data
-		uint32_t magic;
-
-		image_file.read(reinterpret_cast<char*>(&magic), 4);
-		magic = swap_endian(magic);
-		if (magic != 2051) {
-			throw std::runtime_error("Incorrect image file magic: " + std::to_string(magic));
-		}
-
-		label_file.read(reinterpret_cast<char*>(&magic), 4);
-		magic = swap_endian(magic);
-		if (magic != 2049) {
-			throw std::runtime_error("Incorrect label file magic: " + std::to_string(magic));
+	std::thread loader;
+	mutable std::mutex progress_mutex;
+	mutable std::condition_variable progress;
+	size_t items_loaded = 0;
+	std::exception_ptr load_error;
+
+	void open_mnist(const std::string& image_filename, const std::string& label_filename) {
+		// Open files, gzip is detected by its magic and inflated while reading
+		image_file.reset(new IdxReader(image_filename));
+		label_file.reset(new IdxReader(label_filename));
+
+		// images are rank >= 2 (items x rows x ...), labels are a rank 1 integer column
+		const IdxHeader& imageHeader = image_file->header();
+		const IdxHeader& labelHeader = label_file->header();
+		imageHeader.imageShape(rows, cols);
+		if (!labelHeader.isLabelColumn()) {
+			throw std::runtime_error("Label file must be a 1-dimensional integer IDX file.");
 		}
 
-		image_file.read(reinterpret_cast<char*>(&num_items), 4);
-		num_items = swap_endian(num_items);
-		label_file.read(reinterpret_cast<char*>(&num_labels), 4);
-		num_labels = swap_endian(num_labels);
+		num_items = imageHeader.dims[0];
+		num_labels = labelHeader.dims[0];
 		if (num_items != num_labels) {
 			throw std::runtime_error("Number of images does not match number of labels.");
 		}
 
-		image_file.read(reinterpret_cast<char*>(&rows), 4);
-		rows = swap_endian(rows);
-		image_file.read(reinterpret_cast<char*>(&cols), 4);
-		cols = swap_endian(cols);
+		pixel_scale = imageHeader.type == IdxType::uint8 ? 1.0 / 255.0 : 1.0;
 
 		std::cout << "Number of images and labels: " << num_items << std::endl;
 		std::cout << "Image dimensions: " << rows << "x" << cols << std::endl;
 
-		// Convert cv::Mat to matrix objects for every image
-		char* pixels = new char[rows * cols];
-
-		for (int item_id = 0; item_id < num_items; ++item_id) {
-			// read image pixel
-			image_file.read(pixels, rows * cols);
-			// read label
-			label_file.read(&label, 1);
-
-			// Convert image data to Matrix object and store
-			Matrix img_matrix(rows, cols);
-			for (int i = 0; i < rows; ++i) {
-				for (int j = 0; j < cols; ++j) {
-					// normalization to get pixel vals between [0, 1]
-					img_matrix[i][j] = static_cast<double>(static_cast<unsigned char>((pixels[i * cols + j]))) / 255.0;
+		images.assign(num_items, Matrix(rows, cols));
+		labels.assign(num_items, 0);
+	}
+
+	void load_mnist() {
+		try {
+			// decode in chunks so readers get woken up regularly rather than once per image
+			const size_t chunkItems = 256;
+			const size_t imageSize = rows * cols;
+			std::vector<double> pixels(chunkItems * imageSize);
+			std::vector<int> chunkLabels(chunkItems);
+
+			for (size_t start = 0; start < num_items; start += chunkItems) {
+				size_t count = std::min<size_t>(chunkItems, num_items - start);
+				image_file->readItems(pixels.data(), count);
+				label_file->readItems(chunkLabels.data(), count);
+
+				for (size_t n = 0; n < count; n++) {
+					// Convert image data to Matrix object and store
+					Matrix& img_matrix = images[start + n];
+					const double* img = pixels.data() + n * imageSize;
+					for (size_t i = 0; i < rows; ++i) {
+						for (size_t j = 0; j < cols; ++j) {
+							// normalization to get pixel vals between [0, 1]
+							img_matrix[i][j] = img[i * cols + j] * pixel_scale;
+						}
+					}
+
+					// store label
+					labels[start + n] = chunkLabels[n];
 				}
-			}
-			images.push_back(img_matrix);
 
-			// store label
-			labels.push_back(static_cast<int>(label));
+				{
+					std::lock_guard<std::mutex> lock(progress_mutex);
+					items_loaded = start + count;
+				}
+				progress.notify_all();
+			}
 		}
-		delete[] pixels;
+		catch (...) {
+			{
+				std::lock_guard<std::mutex> lock(progress_mutex);
+				load_error = std::current_exception();
+			}
+			progress.notify_all();
+		}
+
+		image_file.reset();
+		label_file.reset();
 	}
-};
\ No newline at end of file
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// read-only memory mapping of a whole file, pages are shared with every other process mapping it
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& filename) {
+#ifdef _WIN32
+		file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("Unable to open file for mapping: " + filename);
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize)) {
+			CloseHandle(file);
+			throw std::runtime_error("Unable to read the size of " + filename);
+		}
+		length = static_cast<size_t>(fileSize.QuadPart);
+		if (length > 0) {
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping == nullptr) {
+				CloseHandle(file);
+				throw std::runtime_error("Unable to map file: " + filename);
+			}
+			view = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (view == nullptr) {
+				CloseHandle(mapping);
+				CloseHandle(file);
+				throw std::runtime_error("Unable to map file: " + filename);
+			}
+		}
+#else
+		fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error("Unable to open file for mapping: " + filename);
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			close(fd);
+			throw std::runtime_error("Unable to read the size of " + filename);
+		}
+		length = static_cast<size_t>(st.st_size);
+		if (length > 0) {
+			void* addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+			if (addr == MAP_FAILED) {
+				close(fd);
+				throw std::runtime_error("Unable to map file: " + filename);
+			}
+			view = static_cast<const uint8_t*>(addr);
+		}
+#endif
+	}
+
+	~MappedFile() {
+#ifdef _WIN32
+		if (view) {
+			UnmapViewOfFile(view);
+		}
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+#else
+		if (view) {
+			munmap(const_cast<uint8_t*>(view), length);
+		}
+		close(fd);
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const uint8_t* data() const noexcept {
+		return view;
+	}
+
+	size_t size() const noexcept {
+		return length;
+	}
+
+private:
+	const uint8_t* view = nullptr;
+	size_t length = 0;
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+};
@@ -2,51 +2,85 @@
 #include <vector>
 #include <iostream>
 #include <string>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
 #include "Utils.hpp"
 
 
+// Row-major matrix stored in one contiguous block.
+// A matrix can also be a read-only view of memory owned elsewhere (e.g. a mapped model file);
+// views share that memory when copied and take a private copy the first time they are written to.
 class Matrix {
 public:
 	// Default constructor
-	Matrix() : rows(0), cols(0) { 
-		data.resize(rows, std::vector<double>(cols));
+	Matrix() : rows(0), cols(0) {
 	}
 
 	// Constructor
 	Matrix(size_t numRows, size_t numCols, double initVal = 0.0) : rows(numRows), cols(numCols)
 	{
-		data.resize(rows, std::vector<double>(cols, initVal)); // initialize matrix of vals
+		values.assign(rows * cols, initVal); // initialize matrix of vals
+	}
+
+	// read-only view of rows x cols doubles at data, owner keeps that memory alive for as long as the view
+	static Matrix view(size_t numRows, size_t numCols, const double* data, std::shared_ptr<const void> owner) {
+		Matrix result;
+		result.rows = numRows;
+		result.cols = numCols;
+		result.viewData = data;
+		result.viewOwner = std::move(owner);
+		return result;
+	}
+
+	bool isView() const noexcept {
+		return viewData != nullptr;
 	}
 
 	// Resize
 	void resize(size_t newRows, size_t newCols, double initVal = 0.0) {
-		std::vector<std::vector<double>> newData(newRows, std::vector<double>(newCols, initVal));
+		std::vector<double> newData(newRows * newCols, initVal);
 
 		// copy existing data to the new data structure
+		const double* src = data();
 		for (size_t i = 0; i < std::min(rows, newRows); i++) {
 			for (size_t j = 0; j < std::min(cols, newCols); j++) {
-				newData[i][j] = data[i][j];
+				newData[i * newCols + j] = src[i * cols + j];
 			}
 		}
 
 		// update the data and dimensions
-		data = std::move(newData);
+		values = std::move(newData);
+		viewData = nullptr;
+		viewOwner.reset();
 		rows = newRows;
 		cols = newCols;
 	}
 
 	// Accessors
-	// used to modify the matrix
-	std::vector<double>& operator[](size_t index) {
-		return data[index];
+	// used to modify the matrix, returns a pointer to the start of the row so m[i][j] works as before
+	double* operator[](size_t index) {
+		return data() + index * cols;
 	}
 
 	// used to access but not modify, with the same code as the modifying function
-	// note that the first const indicates the return matrix's structure cannot be modified,
-	// although the elements inside can be (because they are not const)
 	// also, the const at the end shows that this function will not change member vars of the class
-	const std::vector<double>& operator[](size_t index) const {
-		return data[index];
+	const double* operator[](size_t index) const {
+		return data() + index * cols;
+	}
+
+	// contiguous row-major storage, writing through it detaches a view from its shared memory
+	double* data() {
+		if (viewData) {
+			values.assign(viewData, viewData + rows * cols);
+			viewData = nullptr;
+			viewOwner.reset();
+		}
+		return values.data();
+	}
+
+	const double* data() const noexcept {
+		return viewData ? viewData : values.data();
 	}
 
 	size_t numRows() const noexcept {
@@ -66,8 +100,9 @@ public:
 			throw std::invalid_argument("Invalid column data size.");
 		}
 
+		double* dst = data();
 		for (size_t i = 0; i < rows; i++) {
-			data[i][colIdx] = colData[i];
+			dst[i * cols + colIdx] = colData[i];
 		}
 	}
 
@@ -77,18 +112,20 @@ public:
 		}
 
 		Matrix result(rows, 1);
+		const double* src = data();
 		for (size_t i = 0; i < rows; ++i) {
-			result.data[i][0] = data[i][colIdx];
+			result.values[i] = src[i * cols + colIdx];
 		}
 		return result;
 	}
 
-	const std::vector<double>& getRow(size_t rowIdx) const {
+	std::vector<double> getRow(size_t rowIdx) const {
 		if (rowIdx >= rows) {
 			throw std::out_of_range("Invalid row index.");
 		}
 
-		return data[rowIdx];
+		const double* row = (*this)[rowIdx];
+		return std::vector<double>(row, row + cols);
 	}
 
 	void shape() const noexcept {
@@ -102,7 +139,7 @@ public:
 	void print() const {
 		for (size_t i = 0; i < rows; ++i) {
 			for (size_t j = 0; j < cols; ++j) {
-				std::cout << data[i][j] << " ";
+				std::cout << (*this)[i][j] << " ";
 			}
 			std::cout << std::endl;
 		}
@@ -116,11 +153,11 @@ public:
 		}
 
 		Matrix result(rows, cols);
+		const double* a = data();
+		const double* b = other.data();
 
-		for (int i = 0; i < rows; i++) {
-			for (int j = 0; j < cols; j++) {
-				result.data[i][j] = data[i][j] + other.data[i][j];
-			}
+		for (size_t i = 0; i < rows * cols; i++) {
+			result.values[i] = a[i] + b[i];
 		}
 		return result;
 	}
@@ -132,23 +169,22 @@ public:
 		}
 
 		Matrix result(rows, cols);
+		const double* a = data();
+		const double* b = other.data();
 
-		for (int i = 0; i < rows; i++) {
-			for (int j = 0; j < cols; j++) {
-				result.data[i][j] = data[i][j] - other.data[i][j];
-			}
+		for (size_t i = 0; i < rows * cols; i++) {
+			result.values[i] = a[i] - b[i];
 		}
 		return result;
 	}
 
-	// scalar addition 
+	// scalar addition
 	Matrix operator+(const double scalar) const {
 		Matrix result(rows, cols);
+		const double* a = data();
 
-		for (int i = 0; i < rows; i++) {
-			for (int j = 0; j < cols; j++) {
-				result.data[i][j] = data[i][j] + scalar;
-			}
+		for (size_t i = 0; i < rows * cols; i++) {
+			result.values[i] = a[i] + scalar;
 		}
 		return result;
 	}
@@ -157,11 +193,10 @@ public:
 	// scalar subtraction
 	Matrix operator-(const double scalar) const {
 		Matrix result(rows, cols);
+		const double* a = data();
 
-		for (int i = 0; i < rows; i++) {
-			for (int j = 0; j < cols; j++) {
-				result.data[i][j] = data[i][j] - scalar;
-			}
+		for (size_t i = 0; i < rows * cols; i++) {
+			result.values[i] = a[i] - scalar;
 		}
 		return result;
 	}
@@ -172,15 +207,21 @@ public:
 			throw std::runtime_error("Matrix dimensions do not match for multiplication.");
 		}
 
-		Matrix result(rows, other.numCols());
+		const size_t n = other.numCols();
+		Matrix result(rows, n);
+		const double* a = data();
+		const double* b = other.data();
+		double* c = result.values.data();
 
-		for (int i = 0; i < rows; i++) {
-			for (int j = 0; j < other.numCols(); j++) {
-				double sum = 0.0;
-				for (int k = 0; k < cols; k++) {
-					sum += data[i][k] * other.data[k][j];
+		// i-k-j order walks both b and the result row by row
+		for (size_t i = 0; i < rows; i++) {
+			for (size_t k = 0; k < cols; k++) {
+				const double aik = a[i * cols + k];
+				const double* bRow = b + k * n;
+				double* cRow = c + i * n;
+				for (size_t j = 0; j < n; j++) {
+					cRow[j] += aik * bRow[j];
 				}
-				result.data[i][j] = sum;
 			}
 		}
 		return result;
@@ -195,11 +236,11 @@ public:
 		}
 
 		Matrix result(rows, cols);
+		const double* a = data();
+		const double* b = other.data();
 
-		for (size_t i = 0; i < rows; i++) {
-			for (size_t j = 0; j < cols; j++) {
-				result.data[i][j] = data[i][j] * other.data[i][j];
-			}
+		for (size_t i = 0; i < rows * cols; i++) {
+			result.values[i] = a[i] * b[i];
 		}
 		return result;
 	}
@@ -207,11 +248,10 @@ public:
 	// scalar multiplication
 	Matrix operator*(const double scalar) const {
 		Matrix result(rows, cols);
+		const double* a = data();
 
-		for (int i = 0; i < rows; i++) {
-			for (int j = 0; j < cols; j++) {
-				result.data[i][j] = data[i][j] * scalar;
-			}
+		for (size_t i = 0; i < rows * cols; i++) {
+			result.values[i] = a[i] * scalar;
 		}
 		return result;
 	}
@@ -219,11 +259,12 @@ public:
 	// transposition
 	Matrix T() const {
 		Matrix result(cols, rows);
+		const double* a = data();
 
-		// reverse indices 
-		for (int i = 0; i < rows; i++) {
-			for (int j = 0; j < cols; j++) {
-				result.data[j][i] = data[i][j];
+		// reverse indices
+		for (size_t i = 0; i < rows; i++) {
+			for (size_t j = 0; j < cols; j++) {
+				result.values[j * rows + i] = a[i * cols + j];
 			}
 		}
 		return result;
@@ -234,19 +275,15 @@ public:
 		Matrix result(vec.size(), 1);
 
 		for (size_t i = 0; i < vec.size(); i++) {
-			result.data[i][0] = vec[i];
+			result.values[i] = vec[i];
 		}
 		return result;
 	}
 
-	// flatten matrix to column vector
+	// flatten matrix to column vector, row-major storage means the values are already in order
 	Matrix flatten() const {
 		Matrix result(numRows() * numCols(), 1);
-		for (size_t i = 0; i < numRows(); i++) {
-			for (size_t j = 0; j < numCols(); j++) {
-				result.data[i * numCols() + j][0] = data[i][j];
-			}
-		}
+		std::copy(data(), data() + rows * cols, result.values.begin());
 		return result;
 	}
 
@@ -254,5 +291,9 @@ private:
 	size_t rows;
 	size_t cols;
 
-	std::vector<std::vector<double>> data;
-};
\ No newline at end of file
+	std::vector<double> values;
+
+	// set when the matrix is a read-only view of external memory
+	const double* viewData = nullptr;
+	std::shared_ptr<const void> viewOwner;
+};
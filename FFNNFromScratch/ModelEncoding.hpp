@@ -0,0 +1,274 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "Matrix.hpp"
+#include "Compress.hpp"
+
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#include <immintrin.h>
+#endif
+
+// how the values of a stored tensor are encoded
+enum class ModelDType : uint32_t {
+	float64 = 0,
+	float32 = 1,
+	float16 = 2, // IEEE half
+	bfloat16 = 3, // upper half of a float32
+	int8 = 4 // symmetric per output channel: one float32 scale per row, then the int8 values row by row
+};
+
+enum class ModelCompression : uint32_t {
+	none = 0,
+	shuffleLz = 1, // byteShuffle by element size, then lzCompress
+	shuffleHuffman = 2 // byteShuffle by element size, then one huffmanCompress stream per byte plane
+};
+
+inline size_t modelDTypeSize(ModelDType dtype) {
+	switch (dtype) {
+	case ModelDType::float64: return 8;
+	case ModelDType::float32: return 4;
+	case ModelDType::float16: return 2;
+	case ModelDType::bfloat16: return 2;
+	case ModelDType::int8: return 1;
+	}
+	throw std::runtime_error("Unknown model dtype: " + std::to_string(static_cast<uint32_t>(dtype)));
+}
+
+// size of an uncompressed rows x cols tensor
+inline uint64_t encodedTensorBytes(ModelDType dtype, uint64_t rows, uint64_t cols) {
+	uint64_t bytes = rows * cols * modelDTypeSize(dtype);
+	return dtype == ModelDType::int8 ? bytes + rows * sizeof(float) : bytes;
+}
+
+// round to nearest even, out of range values become infinity
+inline uint16_t floatToHalf(float value) {
+	uint32_t x;
+	std::memcpy(&x, &value, 4);
+	uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000);
+	x &= 0x7FFFFFFF;
+
+	if (x >= 0x7F800000) {
+		return sign | 0x7C00 | (x > 0x7F800000 ? 0x200 | ((x >> 13) & 0x3FF) : 0); // inf or quiet nan
+	}
+	if (x >= 0x477FF000) {
+		return sign | 0x7C00; // 65520 and up round past the largest half
+	}
+	if (x < 0x38800000) {
+		// subnormal half, scaling by 2^24 is exact and nearbyint rounds to even
+		return sign | static_cast<uint16_t>(std::nearbyint(std::fabs(value) * 16777216.0f));
+	}
+	return sign | static_cast<uint16_t>((x - 0x38000000 + 0xFFF + ((x >> 13) & 1)) >> 13);
+}
+
+inline float halfToFloat(uint16_t h) {
+	uint32_t sign = uint32_t(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1F;
+	uint32_t mantissa = h & 0x3FF;
+
+	uint32_t x;
+	if (exponent == 0) {
+		float value = mantissa / 16777216.0f;
+		std::memcpy(&x, &value, 4);
+		x |= sign;
+	}
+	else if (exponent == 31) {
+		x = sign | 0x7F800000 | (mantissa << 13);
+	}
+	else {
+		x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+
+	float result;
+	std::memcpy(&result, &x, 4);
+	return result;
+}
+
+inline uint16_t floatToBFloat16(float value) {
+	uint32_t x;
+	std::memcpy(&x, &value, 4);
+	if ((x & 0x7FFFFFFF) > 0x7F800000) {
+		return static_cast<uint16_t>((x >> 16) | 0x40); // keep nan a nan
+	}
+	return static_cast<uint16_t>((x + 0x7FFF + ((x >> 16) & 1)) >> 16);
+}
+
+inline float bfloat16ToFloat(uint16_t b) {
+	uint32_t x = uint32_t(b) << 16;
+	float result;
+	std::memcpy(&result, &x, 4);
+	return result;
+}
+
+// matrix values -> stored bytes, doubles are narrowed to float first for the 16-bit types
+inline std::vector<uint8_t> encodeTensor(const Matrix& m, ModelDType dtype, ModelCompression compression) {
+	const size_t rows = m.numRows();
+	const size_t cols = m.numCols();
+	const size_t n = rows * cols;
+	const double* src = m.data();
+	std::vector<uint8_t> raw(static_cast<size_t>(encodedTensorBytes(dtype, rows, cols)));
+
+	switch (dtype) {
+	case ModelDType::float64:
+		std::memcpy(raw.data(), src, n * sizeof(double));
+		break;
+	case ModelDType::float32: {
+		float* dst = reinterpret_cast<float*>(raw.data());
+		for (size_t i = 0; i < n; i++) {
+			dst[i] = static_cast<float>(src[i]);
+		}
+		break;
+	}
+	case ModelDType::float16: {
+		uint16_t* dst = reinterpret_cast<uint16_t*>(raw.data());
+		size_t i = 0;
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+		for (; i + 8 <= n; i += 8) {
+			__m256 v = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_loadu_pd(src + i + 4)), _mm256_cvtpd_ps(_mm256_loadu_pd(src + i)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+		}
+#endif
+		for (; i < n; i++) {
+			dst[i] = floatToHalf(static_cast<float>(src[i]));
+		}
+		break;
+	}
+	case ModelDType::bfloat16: {
+		uint16_t* dst = reinterpret_cast<uint16_t*>(raw.data());
+		for (size_t i = 0; i < n; i++) {
+			dst[i] = floatToBFloat16(static_cast<float>(src[i]));
+		}
+		break;
+	}
+	case ModelDType::int8: {
+		float* scales = reinterpret_cast<float*>(raw.data());
+		int8_t* q = reinterpret_cast<int8_t*>(raw.data() + rows * sizeof(float));
+		for (size_t r = 0; r < rows; r++) {
+			double maxAbs = 0.0;
+			for (size_t c = 0; c < cols; c++) {
+				maxAbs = std::max(maxAbs, std::fabs(src[r * cols + c]));
+			}
+			scales[r] = static_cast<float>(maxAbs / 127.0);
+			double inverse = maxAbs > 0.0 ? 127.0 / maxAbs : 0.0;
+			for (size_t c = 0; c < cols; c++) {
+				double v = std::nearbyint(src[r * cols + c] * inverse);
+				q[r * cols + c] = static_cast<int8_t>(std::min(std::max(v, -127.0), 127.0));
+			}
+		}
+		break;
+	}
+	default:
+		throw std::runtime_error("Unknown model dtype: " + std::to_string(static_cast<uint32_t>(dtype)));
+	}
+
+	if (compression == ModelCompression::none) {
+		return raw;
+	}
+	const size_t elementSize = modelDTypeSize(dtype);
+	const size_t count = raw.size() / elementSize;
+	std::vector<uint8_t> shuffled(raw.size());
+	byteShuffle(raw.data(), shuffled.data(), count, elementSize);
+	if (compression == ModelCompression::shuffleLz) {
+		return lzCompress(shuffled.data(), shuffled.size());
+	}
+
+	// int8 tensors keep their float scales in front of the values, those are coded as a plane of their own
+	std::vector<uint8_t> out;
+	size_t planeStart = 0;
+	if (dtype == ModelDType::int8) {
+		huffmanCompress(shuffled.data(), rows * sizeof(float), out);
+		planeStart = rows * sizeof(float);
+	}
+	const size_t planeSize = (shuffled.size() - planeStart) / elementSize;
+	for (size_t b = 0; b < elementSize; b++) {
+		huffmanCompress(shuffled.data() + planeStart + b * planeSize, planeSize, out);
+	}
+	return out;
+}
+
+// stored bytes -> values of out, which already has the tensor's shape
+inline void decodeTensor(const uint8_t* stored, size_t storedBytes, ModelDType dtype, ModelCompression compression, Matrix& out) {
+	const size_t rows = out.numRows();
+	const size_t cols = out.numCols();
+	const size_t n = rows * cols;
+	const size_t rawBytes = static_cast<size_t>(encodedTensorBytes(dtype, rows, cols));
+	double* dst = out.data();
+
+	std::vector<uint8_t> raw;
+	const uint8_t* src = stored;
+	if (compression != ModelCompression::none) {
+		const size_t elementSize = modelDTypeSize(dtype);
+		std::vector<uint8_t> shuffled(rawBytes);
+		if (compression == ModelCompression::shuffleLz) {
+			lzDecompress(stored, storedBytes, shuffled.data(), shuffled.size());
+		}
+		else {
+			size_t used = 0;
+			size_t planeStart = 0;
+			if (dtype == ModelDType::int8) {
+				used += huffmanDecompress(stored, storedBytes, shuffled.data(), rows * sizeof(float));
+				planeStart = rows * sizeof(float);
+			}
+			const size_t planeSize = (rawBytes - planeStart) / elementSize;
+			for (size_t b = 0; b < elementSize; b++) {
+				used += huffmanDecompress(stored + used, storedBytes - used, shuffled.data() + planeStart + b * planeSize, planeSize);
+			}
+		}
+		raw.resize(rawBytes);
+		byteUnshuffle(shuffled.data(), raw.data(), rawBytes / elementSize, elementSize);
+		src = raw.data();
+	}
+	else if (storedBytes != rawBytes) {
+		throw std::runtime_error("Stored tensor size does not match its shape");
+	}
+
+	switch (dtype) {
+	case ModelDType::float64:
+		std::memcpy(dst, src, n * sizeof(double));
+		break;
+	case ModelDType::float32: {
+		const float* values = reinterpret_cast<const float*>(src);
+		for (size_t i = 0; i < n; i++) {
+			dst[i] = values[i];
+		}
+		break;
+	}
+	case ModelDType::float16: {
+		const uint16_t* values = reinterpret_cast<const uint16_t*>(src);
+		size_t i = 0;
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+		for (; i + 8 <= n; i += 8) {
+			__m256 v = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)));
+			_mm256_storeu_pd(dst + i, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+			_mm256_storeu_pd(dst + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+		}
+#endif
+		for (; i < n; i++) {
+			dst[i] = halfToFloat(values[i]);
+		}
+		break;
+	}
+	case ModelDType::bfloat16: {
+		const uint16_t* values = reinterpret_cast<const uint16_t*>(src);
+		for (size_t i = 0; i < n; i++) {
+			dst[i] = bfloat16ToFloat(values[i]);
+		}
+		break;
+	}
+	case ModelDType::int8: {
+		const float* scales = reinterpret_cast<const float*>(src);
+		const int8_t* q = reinterpret_cast<const int8_t*>(src + rows * sizeof(float));
+		for (size_t r = 0; r < rows; r++) {
+			for (size_t c = 0; c < cols; c++) {
+				dst[r * cols + c] = q[r * cols + c] * static_cast<double>(scales[r]);
+			}
+		}
+		break;
+	}
+	default:
+		throw std::runtime_error("Unknown model dtype: " + std::to_string(static_cast<uint32_t>(dtype)));
+	}
+}
@@ -0,0 +1,211 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <stdexcept>
+#include "InferenceSession.hpp"
+#include "Serialize.hpp"
+
+// Epoch-based read-side critical sections, the reclamation half of RCU. A reader announces the
+// global epoch in its own slot on entry and clears it on exit, two atomic stores and no lock. A
+// writer that unpublishes an object advances the epoch and may free the object once no slot still
+// holds an epoch from before the advance: every reader that could have seen the object has left.
+class EpochDomain {
+public:
+	static constexpr size_t maxThreads = 256;
+
+	static EpochDomain& instance() {
+		static EpochDomain domain;
+		return domain;
+	}
+
+	// nested sections on one thread share the outermost announcement
+	void enter() {
+		ThreadState& state = threadState();
+		if (state.depth++ == 0) {
+			Slot& slot = slots[state.slot];
+			slot.epoch.store(epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+		}
+	}
+
+	void leave() {
+		ThreadState& state = threadState();
+		if (--state.depth == 0) {
+			slots[state.slot].epoch.store(0, std::memory_order_release);
+		}
+	}
+
+	// moves the epoch on after an object was unpublished, the result is the object's retire epoch
+	uint64_t advance() {
+		return epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+	}
+
+	// true once no reader is inside a section that began before retireEpoch
+	bool quiescent(uint64_t retireEpoch) const {
+		for (const Slot& slot : slots) {
+			uint64_t seen = slot.epoch.load(std::memory_order_seq_cst);
+			if (seen != 0 && seen < retireEpoch) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	struct alignas(64) Slot {
+		std::atomic<uint64_t> epoch{ 0 }; // 0 = outside any section
+		std::atomic<bool> owned{ false };
+	};
+
+	// a thread claims a slot on its first section and gives it back when it exits
+	struct ThreadState {
+		size_t slot;
+		size_t depth = 0;
+
+		ThreadState() {
+			EpochDomain& domain = EpochDomain::instance();
+			for (size_t i = 0; i < maxThreads; i++) {
+				bool expected = false;
+				if (domain.slots[i].owned.compare_exchange_strong(expected, true)) {
+					slot = i;
+					return;
+				}
+			}
+			throw std::runtime_error("More than " + std::to_string(maxThreads) + " threads reading from the model registry.");
+		}
+
+		~ThreadState() {
+			EpochDomain::instance().slots[slot].owned.store(false, std::memory_order_release);
+		}
+	};
+
+	std::atomic<uint64_t> epoch{ 1 };
+	Slot slots[maxThreads];
+
+	static ThreadState& threadState() {
+		thread_local ThreadState state;
+		return state;
+	}
+};
+
+// Holds the model requests are served from and swaps in new ones while they run. The current
+// entry is one atomic pointer: readers load it inside an epoch section, with no lock and no
+// reference count touched unless they keep the model (InferenceSession does, by copying the
+// shared_ptr). publish() frees the replaced entry after a grace period, once every reader that
+// could still see it has left, so read sections should stay short and must not publish. A request
+// already computing keeps its model alive through its own shared_ptr and finishes on the old weights.
+class ModelRegistry {
+public:
+	struct Entry {
+		std::shared_ptr<const CompiledModel> model;
+		uint64_t version; // 1 for the first model, +1 per swap
+		std::string source; // file it was loaded from, if any
+	};
+
+	// scoped read access to the current entry, valid until the guard is destroyed
+	class ReadGuard {
+	public:
+		explicit ReadGuard(const ModelRegistry& registry) {
+			EpochDomain::instance().enter();
+			entry = registry.current.load(std::memory_order_seq_cst);
+		}
+
+		~ReadGuard() {
+			EpochDomain::instance().leave();
+		}
+
+		ReadGuard(const ReadGuard&) = delete;
+		ReadGuard& operator=(const ReadGuard&) = delete;
+
+		const Entry& operator*() const noexcept {
+			return *entry;
+		}
+
+		const Entry* operator->() const noexcept {
+			return entry;
+		}
+
+	private:
+		const Entry* entry;
+	};
+
+	explicit ModelRegistry(std::shared_ptr<const CompiledModel> initial, const std::string& source = "") {
+		if (!initial) {
+			throw std::invalid_argument("Model registry needs an initial model.");
+		}
+		numInputs = initial->numInputs();
+		numOutputs = initial->numOutputs();
+		current.store(new Entry{ std::move(initial), 1, source });
+	}
+
+	static std::shared_ptr<ModelRegistry> fromFile(const std::string& filename) {
+		return std::make_shared<ModelRegistry>(std::make_shared<const CompiledModel>(readModel(filename)), filename);
+	}
+
+	// no reader may still be using the registry
+	~ModelRegistry() {
+		delete current.load();
+	}
+
+	ModelRegistry(const ModelRegistry&) = delete;
+	ModelRegistry& operator=(const ModelRegistry&) = delete;
+
+	ReadGuard read() const {
+		return ReadGuard(*this);
+	}
+
+	// the current model, kept alive by the returned reference after any later swap
+	std::shared_ptr<const CompiledModel> acquire() const {
+		ReadGuard guard(*this);
+		return guard->model;
+	}
+
+	uint64_t version() const {
+		ReadGuard guard(*this);
+		return guard->version;
+	}
+
+	// makes model current for every read that starts after this returns, and returns its version.
+	// The input and output sizes may not change, queued requests were checked against them.
+	uint64_t publish(std::shared_ptr<const CompiledModel> model, const std::string& source = "") {
+		if (!model || model->numInputs() != numInputs || model->numOutputs() != numOutputs) {
+			throw std::invalid_argument("A replacement model must keep " + std::to_string(numInputs) + " inputs and " + std::to_string(numOutputs) + " outputs.");
+		}
+
+		std::lock_guard<std::mutex> lock(writeMutex);
+		const Entry* old = current.load(std::memory_order_relaxed);
+		const uint64_t version = old->version + 1;
+		current.store(new Entry{ std::move(model), version, source }, std::memory_order_seq_cst);
+
+		// grace period: sections that started before the swap may still hold old
+		EpochDomain& domain = EpochDomain::instance();
+		const uint64_t retireEpoch = domain.advance();
+		while (!domain.quiescent(retireEpoch)) {
+			std::this_thread::yield();
+		}
+		delete old;
+		return version;
+	}
+
+	// reads, compiles and publishes a model file; the current model stays if the file can't be read
+	uint64_t load(const std::string& filename) {
+		return publish(std::make_shared<const CompiledModel>(readModel(filename)), filename);
+	}
+
+	size_t getNumInputs() const noexcept {
+		return numInputs;
+	}
+
+	size_t getNumOutputs() const noexcept {
+		return numOutputs;
+	}
+
+private:
+	std::atomic<const Entry*> current;
+	size_t numInputs;
+	size_t numOutputs;
+	std::mutex writeMutex; // serializes writers only, readers never take it
+};
@@ -0,0 +1,371 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <optional>
+#include <span>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include "DynamicBatcher.hpp"
+#include "ThreadPool.hpp"
+#include "PredictionCache.hpp"
+
+// how much of the shared pool a hosted model may use
+struct ModelQuota {
+	double weight = 1.0; // share of the pool while several models have work queued
+	size_t maxConcurrency = 0; // batches of this model computing at once, 0 = up to the whole pool
+};
+
+// per-model counters, totals since the model was added unless noted
+struct ModelCounters {
+	BatchingMetrics batching{}; // requests, batches, current limits and the last period's p99
+	uint64_t version = 0; // of the model currently served
+	size_t queued = 0; // waiting for a batch, at the time of the call
+	size_t inFlight = 0; // batches computing, at the time of the call
+	double computeMicros = 0.0; // pool time spent on this model's batches
+	double latencyMicros = 0.0; // summed enqueue -> result over every answered request
+	CacheMetrics cache{}; // all zero without a prediction cache; hits never reach the batching counters
+};
+
+// Hosts several models on one ThreadPool. Each model has its own request queue and BatchScheduler,
+// so it batches exactly as a DynamicBatcher would, but a batch only runs when a pool thread is free.
+// A single dispatcher thread decides which model's batch gets the next free thread:
+//   - a model is eligible once its batch is full or its oldest request has waited the window, and
+//     while fewer of its batches compute than its quota allows
+//   - among eligible models it uses start-time fair queueing: a batch of n requests advances its
+//     model's tag by n / weight and the lowest tag goes first, so under contention each model gets
+//     pool time in proportion to its weight however fast its requests arrive. A model that was idle
+//     starts at the current virtual time and can't claim the pool for the time it didn't use.
+// Batches are only handed to the pool when a thread is idle, the pool's own FIFO never reorders them.
+// A model can have a PredictionCache in front of its queue: a repeated input is answered on the
+// submitting thread and never queued.
+class MultiModelBatcher {
+public:
+	using Callback = DynamicBatcher::Callback;
+
+	explicit MultiModelBatcher(size_t threads) : pool(threads) {
+		dispatcher = std::thread([this] { dispatchLoop(); });
+	}
+
+	// requests still queued are computed and answered before the threads exit
+	~MultiModelBatcher() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		dispatcher.join();
+		// the pool is the last member, destroying it first finishes the batches it still runs
+	}
+
+	MultiModelBatcher(const MultiModelBatcher&) = delete;
+	MultiModelBatcher& operator=(const MultiModelBatcher&) = delete;
+
+	// returns the model's index for submit(); options.workers is unused, the quota bounds concurrency.
+	// cacheBytes > 0 gives the model its own prediction cache of that size.
+	size_t addModel(const std::string& name, std::shared_ptr<ModelRegistry> registry, const ModelQuota& quota, const BatchingOptions& options, size_t cacheBytes = 0) {
+		if (!registry) {
+			throw std::invalid_argument("Model " + name + " has no registry.");
+		}
+		if (options.maxBatch == 0 || !(quota.weight > 0.0)) {
+			throw std::invalid_argument("Model " + name + " needs a max batch of at least 1 and a positive weight.");
+		}
+		auto model = std::make_unique<Model>(name, std::move(registry), options);
+		model->maxConcurrency = quota.maxConcurrency == 0 ? pool.size() : quota.maxConcurrency;
+		model->weight = quota.weight;
+		if (cacheBytes > 0) {
+			model->cache = std::make_unique<PredictionCache>(cacheBytes);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (findLocked(name) != models.size()) {
+			throw std::invalid_argument("A model named " + name + " is already hosted.");
+		}
+		models.push_back(std::move(model));
+		return models.size() - 1;
+	}
+
+	size_t numModels() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return models.size();
+	}
+
+	// index of the named model, throws if it isn't hosted
+	size_t findModel(const std::string& name) const {
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t index = findLocked(name);
+		if (index == models.size()) {
+			throw std::invalid_argument("No model named " + name + " is hosted.");
+		}
+		return index;
+	}
+
+	const std::string& getName(size_t model) const {
+		return at(model).name;
+	}
+
+	ModelRegistry& getRegistry(size_t model) const {
+		return *at(model).registry;
+	}
+
+	ModelCounters getCounters(size_t model) const {
+		const Model& m = at(model);
+		ModelCounters counters{ m.scheduler.metrics(), m.registry->version() };
+		counters.cache = m.cache ? m.cache->metrics() : CacheMetrics{};
+		std::lock_guard<std::mutex> lock(mutex);
+		counters.queued = m.queue.size();
+		counters.inFlight = m.inFlight;
+		counters.computeMicros = m.computeMicros;
+		counters.latencyMicros = m.latencyMicros;
+		return counters;
+	}
+
+	void submit(size_t model, std::span<const float> input, size_t k, Callback done) {
+		Model& m = at(model);
+		if (input.size() != m.registry->getNumInputs()) {
+			throw std::invalid_argument("Request has " + std::to_string(input.size()) + " inputs, model " + m.name + " expects " + std::to_string(m.registry->getNumInputs()));
+		}
+
+		uint64_t keyHash = 0;
+		if (m.cache) {
+			// the registry version tells the weights apart, the cache belongs to this model alone
+			thread_local std::vector<uint8_t> key;
+			thread_local std::vector<float> outputs;
+			thread_local std::vector<TopKEntry> best;
+			PredictionCache::quantize(input, key);
+			keyHash = PredictionCache::hash(key);
+			outputs.resize(m.registry->getNumOutputs());
+			if (m.cache->lookup(key, keyHash, m.registry->version(), outputs)) {
+				topK(outputs, k, best);
+				done(best);
+				return;
+			}
+		}
+
+		Request request{ std::vector<float>(input.begin(), input.end()), k, std::move(done), std::chrono::steady_clock::now(), keyHash };
+		bool notify;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			m.queue.push_back(std::move(request));
+			// the first request starts the model's deadline, a full batch makes it eligible early
+			notify = m.queue.size() == 1 || m.queue.size() == m.scheduler.batchLimit();
+		}
+		if (notify) {
+			wake.notify_one();
+		}
+	}
+
+private:
+	struct Request {
+		std::vector<float> input;
+		size_t k;
+		Callback done;
+		std::chrono::steady_clock::time_point enqueued;
+		uint64_t keyHash; // of the quantized input, when the model has a cache
+	};
+
+	// what one computing batch needs, kept per model and reused by its later batches
+	struct Worker {
+		std::optional<InferenceSession> session;
+		uint64_t version = 0;
+		std::vector<Request> batch;
+		std::vector<float> inputs;
+		std::vector<float> outputs;
+		std::vector<TopKEntry> best;
+		std::vector<double> queueDelays;
+		std::vector<double> latencies;
+		std::vector<uint8_t> key;
+	};
+
+	struct Model {
+		std::string name;
+		std::shared_ptr<ModelRegistry> registry;
+		BatchingOptions options;
+		BatchScheduler scheduler;
+		double weight = 1.0;
+		size_t maxConcurrency = 1;
+		std::unique_ptr<PredictionCache> cache;
+
+		// guarded by the batcher's mutex
+		std::deque<Request> queue;
+		std::vector<std::unique_ptr<Worker>> idleWorkers; // never more than maxConcurrency are created
+		size_t inFlight = 0;
+		double finishTag = 0.0; // virtual time at which the model's last dispatched batch ends
+		double computeMicros = 0.0;
+		double latencyMicros = 0.0;
+
+		Model(const std::string& name, std::shared_ptr<ModelRegistry> registry, const BatchingOptions& options) :
+			name(name), registry(std::move(registry)), options(options), scheduler(options.maxBatch, options.maxWait, options.latencyTarget)
+		{
+		}
+	};
+
+	mutable std::mutex mutex;
+	std::condition_variable wake; // the dispatcher waits on it for requests, deadlines and free threads
+	std::vector<std::unique_ptr<Model>> models;
+	double virtualTime = 0.0;
+	size_t busyThreads = 0;
+	bool stopping = false;
+	std::thread dispatcher;
+	ThreadPool pool;
+
+	// models are never removed, so a reference stays valid after the lock is released
+	Model& at(size_t model) const {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (model >= models.size()) {
+			throw std::out_of_range("No model with index " + std::to_string(model) + " is hosted.");
+		}
+		return *models[model];
+	}
+
+	size_t findLocked(const std::string& name) const {
+		for (size_t i = 0; i < models.size(); i++) {
+			if (models[i]->name == name) {
+				return i;
+			}
+		}
+		return models.size();
+	}
+
+	void dispatchLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			auto now = std::chrono::steady_clock::now();
+			std::optional<std::chrono::steady_clock::time_point> deadline;
+
+			while (busyThreads < pool.size()) {
+				Model* next = nullptr;
+				double nextTag = 0.0;
+				for (auto& model : models) {
+					Model& m = *model;
+					if (m.queue.empty()) {
+						continue;
+					}
+					if (m.inFlight >= m.maxConcurrency) {
+						continue; // its next completion wakes the dispatcher
+					}
+					const auto due = m.queue.front().enqueued + m.scheduler.window();
+					if (m.queue.size() < m.scheduler.batchLimit() && now < due && !stopping) {
+						deadline = deadline ? std::min(*deadline, due) : due;
+						continue;
+					}
+					const double tag = std::max(virtualTime, m.finishTag);
+					if (!next || tag < nextTag) {
+						next = &m;
+						nextTag = tag;
+					}
+				}
+				if (!next) {
+					break;
+				}
+				dispatch(*next, nextTag);
+				now = std::chrono::steady_clock::now();
+			}
+
+			if (stopping && std::all_of(models.begin(), models.end(), [](const auto& m) { return m->queue.empty(); })) {
+				return;
+			}
+			if (deadline && busyThreads < pool.size()) {
+				wake.wait_until(lock, *deadline);
+			}
+			else {
+				wake.wait(lock);
+			}
+		}
+	}
+
+	// called with the lock held
+	void dispatch(Model& m, double startTag) {
+		const size_t count = std::min(m.scheduler.batchLimit(), m.queue.size());
+		virtualTime = startTag;
+		m.finishTag = startTag + count / m.weight;
+		m.inFlight++;
+		busyThreads++;
+
+		std::unique_ptr<Worker> worker;
+		if (m.idleWorkers.empty()) {
+			worker = std::make_unique<Worker>();
+			worker->inputs.resize(m.options.maxBatch * m.registry->getNumInputs());
+			worker->outputs.resize(m.options.maxBatch * m.registry->getNumOutputs());
+			worker->batch.reserve(m.options.maxBatch);
+			worker->queueDelays.reserve(m.options.maxBatch);
+			worker->latencies.reserve(m.options.maxBatch);
+		}
+		else {
+			worker = std::move(m.idleWorkers.back());
+			m.idleWorkers.pop_back();
+		}
+		for (size_t i = 0; i < count; i++) {
+			worker->batch.push_back(std::move(m.queue.front()));
+			m.queue.pop_front();
+		}
+
+		Worker* raw = worker.release();
+		pool.submit([this, &m, raw] { run(m, std::unique_ptr<Worker>(raw)); });
+	}
+
+	// on a pool thread, without the lock
+	void run(Model& m, std::unique_ptr<Worker> worker) {
+		Worker& w = *worker;
+		const size_t count = w.batch.size();
+		const size_t numInputs = m.registry->getNumInputs();
+		const size_t numOutputs = m.registry->getNumOutputs();
+
+		const auto taken = std::chrono::steady_clock::now();
+		{
+			// a new session only when the model was swapped, it keeps its model alive by itself
+			auto current = m.registry->read();
+			if (current->version != w.version) {
+				w.session.emplace(current->model);
+				w.version = current->version;
+			}
+		}
+		for (size_t i = 0; i < count; i++) {
+			std::copy(w.batch[i].input.begin(), w.batch[i].input.end(), w.inputs.begin() + i * numInputs);
+		}
+		w.session->runBatch(std::span<const float>(w.inputs.data(), count * numInputs), std::span<float>(w.outputs.data(), count * numOutputs), count);
+		const auto computed = std::chrono::steady_clock::now();
+
+		double latencySum = 0.0;
+		for (const Request& request : w.batch) {
+			w.queueDelays.push_back(std::chrono::duration<double, std::micro>(taken - request.enqueued).count());
+			w.latencies.push_back(std::chrono::duration<double, std::micro>(computed - request.enqueued).count());
+			latencySum += w.latencies.back();
+		}
+		const double computeMicros = std::chrono::duration<double, std::micro>(computed - taken).count();
+		m.scheduler.record(computeMicros, w.queueDelays, w.latencies);
+		w.queueDelays.clear();
+		w.latencies.clear();
+		// one top-k pass over the batch for the largest k asked for, each request gets its prefix
+		size_t k = 0;
+		for (const Request& request : w.batch) {
+			k = std::max(k, std::min(request.k, numOutputs));
+		}
+		w.best.resize(count * k);
+		topKBatch(w.outputs.data(), numOutputs, count, k, w.best.data());
+		for (size_t i = 0; i < count; i++) {
+			if (m.cache) {
+				PredictionCache::quantize(std::span<const float>(w.batch[i].input), w.key);
+				m.cache->insert(w.key, w.batch[i].keyHash, w.version, std::span<const float>(w.outputs.data() + i * numOutputs, numOutputs));
+			}
+			w.batch[i].done(std::span<const TopKEntry>(w.best.data() + i * k, std::min(w.batch[i].k, numOutputs)));
+		}
+		w.batch.clear();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			m.inFlight--;
+			busyThreads--;
+			m.computeMicros += computeMicros;
+			m.latencyMicros += latencySum;
+			m.idleWorkers.push_back(std::move(worker));
+		}
+		wake.notify_one();
+	}
+};
@@ -0,0 +1,215 @@
+#pragma once
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <span>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include "Checksum.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+struct CacheMetrics {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t insertions;
+	uint64_t evictions; // entries dropped to stay under the memory cap
+	size_t entries;
+	size_t bytes; // keys, outputs and bookkeeping of the entries held now
+	size_t capacity;
+
+	double hitRate() const noexcept {
+		return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0;
+	}
+};
+
+// Outputs of recent inputs, for traffic with exact duplicates such as rescans and retries. The key
+// is the input quantized to one byte per value (inputs are 0-1 pixel intensities, so that is the
+// 0-255 image itself) and found by its 64-bit XXH64 hash; the whole key is compared on a hit, so a
+// hash collision is a miss and never a wrong answer. Each entry also records the generation of the
+// weights that produced it, and a lookup for a different generation misses, so a retrained or
+// swapped model never serves old outputs. Models sharing one cache need distinct generations,
+// newGeneration() hands out process-wide unique ones.
+// Entries are spread over independently locked shards by hash, each an LRU list under an equal
+// share of the memory cap, so concurrent lookups rarely contend and eviction never scans.
+class PredictionCache {
+public:
+	explicit PredictionCache(size_t capacityBytes, size_t numShards = 16) : capacity(capacityBytes) {
+		if (numShards == 0 || (numShards & (numShards - 1)) != 0) {
+			throw std::invalid_argument("Prediction cache shard count must be a power of two.");
+		}
+		shards = std::make_unique<Shard[]>(numShards);
+		shardMask = numShards - 1;
+		shardCapacity = capacityBytes / numShards;
+	}
+
+	PredictionCache(const PredictionCache&) = delete;
+	PredictionCache& operator=(const PredictionCache&) = delete;
+
+	// values in [0, 1] to the bytes round(value * 255), clamped
+	template <typename T>
+	static void quantize(std::span<const T> input, std::vector<uint8_t>& key) {
+		key.resize(input.size());
+		const T* in = input.data();
+		uint8_t* out = key.data();
+		size_t i = 0;
+
+#ifdef __AVX2__
+		// eight values per pass; max/min return their second operand for NaN, so NaN becomes 0 as below
+		const __m128i zero = _mm_setzero_si128();
+		if constexpr (std::is_same_v<T, float>) {
+			const __m256 scale = _mm256_set1_ps(255.0f), half = _mm256_set1_ps(0.5f), low = _mm256_setzero_ps();
+			for (; i + 8 <= input.size(); i += 8) {
+				__m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale), half);
+				__m256i q = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(v, low), scale));
+				__m128i words = _mm_packus_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(words, zero));
+			}
+		}
+		else if constexpr (std::is_same_v<T, double>) {
+			const __m256d scale = _mm256_set1_pd(255.0), half = _mm256_set1_pd(0.5), low = _mm256_setzero_pd();
+			auto convert = [&](const double* p) {
+				__m256d v = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(p), scale), half);
+				return _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(v, low), scale));
+			};
+			for (; i + 8 <= input.size(); i += 8) {
+				__m128i words = _mm_packus_epi32(convert(in + i), convert(in + i + 4));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(words, zero));
+			}
+		}
+#endif
+
+		for (; i < input.size(); i++) {
+			T scaled = in[i] * T(255) + T(0.5);
+			scaled = scaled > T(0) ? scaled : T(0);
+			scaled = scaled < T(255) ? scaled : T(255);
+			out[i] = static_cast<uint8_t>(static_cast<int32_t>(scaled));
+		}
+	}
+
+	static uint64_t hash(std::span<const uint8_t> key) noexcept {
+		return xxHash64(key.data(), key.size());
+	}
+
+	// a generation no other caller in the process has, for a new set of weights
+	static uint64_t newGeneration() noexcept {
+		static std::atomic<uint64_t> next{ 1 };
+		return next.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// copies the cached outputs for key into output and returns true, or returns false
+	bool lookup(std::span<const uint8_t> key, uint64_t keyHash, uint64_t generation, std::span<float> output) {
+		Shard& shard = shardFor(keyHash);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto found = shard.index.find(keyHash);
+		if (found == shard.index.end() || !matches(*found->second, key, generation, output.size())) {
+			shard.misses++;
+			return false;
+		}
+		shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+		std::copy(found->second->outputs.begin(), found->second->outputs.end(), output.begin());
+		shard.hits++;
+		return true;
+	}
+
+	// stores output for key, replacing whatever was cached under the same hash
+	void insert(std::span<const uint8_t> key, uint64_t keyHash, uint64_t generation, std::span<const float> output) {
+		const size_t size = entryBytes(key.size(), output.size());
+		Shard& shard = shardFor(keyHash);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		if (size > shardCapacity) {
+			return;
+		}
+
+		auto found = shard.index.find(keyHash);
+		if (found != shard.index.end()) {
+			shard.bytes -= entryBytes(found->second->key.size(), found->second->outputs.size());
+			shard.lru.erase(found->second);
+			shard.index.erase(found);
+		}
+		while (shard.bytes + size > shardCapacity) {
+			const Entry& oldest = shard.lru.back();
+			shard.bytes -= entryBytes(oldest.key.size(), oldest.outputs.size());
+			shard.index.erase(oldest.hash);
+			shard.lru.pop_back();
+			shard.evictions++;
+		}
+
+		shard.lru.push_front({ keyHash, generation, std::vector<uint8_t>(key.begin(), key.end()), std::vector<float>(output.begin(), output.end()) });
+		shard.index[keyHash] = shard.lru.begin();
+		shard.bytes += size;
+		shard.insertions++;
+	}
+
+	void clear() {
+		for (size_t i = 0; i <= shardMask; i++) {
+			std::lock_guard<std::mutex> lock(shards[i].mutex);
+			shards[i].lru.clear();
+			shards[i].index.clear();
+			shards[i].bytes = 0;
+		}
+	}
+
+	// totals since construction, each shard read under its own lock
+	CacheMetrics metrics() const {
+		CacheMetrics result{ 0, 0, 0, 0, 0, 0, capacity };
+		for (size_t i = 0; i <= shardMask; i++) {
+			std::lock_guard<std::mutex> lock(shards[i].mutex);
+			result.hits += shards[i].hits;
+			result.misses += shards[i].misses;
+			result.insertions += shards[i].insertions;
+			result.evictions += shards[i].evictions;
+			result.entries += shards[i].index.size();
+			result.bytes += shards[i].bytes;
+		}
+		return result;
+	}
+
+private:
+	struct Entry {
+		uint64_t hash;
+		uint64_t generation;
+		std::vector<uint8_t> key;
+		std::vector<float> outputs;
+	};
+
+	// a shard per cache line, so neighbouring shard locks don't false-share
+	struct alignas(64) Shard {
+		mutable std::mutex mutex;
+		std::list<Entry> lru; // most recently used first
+		std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+		size_t bytes = 0;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t insertions = 0;
+		uint64_t evictions = 0;
+	};
+
+	std::unique_ptr<Shard[]> shards;
+	size_t shardMask;
+	size_t capacity;
+	size_t shardCapacity;
+
+	// the top bits pick the shard, the map buckets by the low ones
+	Shard& shardFor(uint64_t keyHash) const noexcept {
+		return shards[(keyHash >> 48) & shardMask];
+	}
+
+	// payload plus the list node, the map node and the two vector allocations, approximately
+	static size_t entryBytes(size_t keySize, size_t numOutputs) noexcept {
+		return sizeof(Entry) + keySize + numOutputs * sizeof(float) + 64;
+	}
+
+	static bool matches(const Entry& entry, std::span<const uint8_t> key, uint64_t generation, size_t numOutputs) noexcept {
+		return entry.generation == generation && entry.outputs.size() == numOutputs && entry.key.size() == key.size()
+			&& std::memcmp(entry.key.data(), key.data(), key.size()) == 0;
+	}
+};
@@ -0,0 +1,274 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+#include "Matrix.hpp"
+#include "Layer.hpp"
+#include "ActivationFunction.hpp"
+#include "FFNN.hpp"
+
+#if defined(__AVX2__) || defined(__AVX512VNNI__)
+#include <immintrin.h>
+#endif
+
+// Int8 post-training quantized inference.
+// Weights are symmetric int8 per output channel (scale = max |w| of the row / 127). Activations are
+// unsigned and stored in 7 bits (0..127): both supported activations are non-negative, and with 7 bits
+// vpmaddubsw's pairwise u8 x s8 sums can't saturate int16. Activation scales come from calibration,
+// i.e. the largest value each layer's input reaches on a sample of real inputs. Network inputs share
+// the unsigned format, so they must not be negative (pixels scaled to [0, 1] are fine); calibration
+// samples and predict() inputs with a negative value are rejected rather than clamped to 0.
+// Samples run one at a time: every layer is an int8 matrix-vector product (GEMV) that reads four
+// weight rows per pass over the input activations.
+// Each output is accumulated in int32, then the epilogue rescales it, adds the bias, applies the
+// activation and requantizes it for the next layer in one step, so no float tensor is materialized.
+class QuantizedFFNN {
+public:
+	QuantizedFFNN(const std::vector<Layer>& source, const std::vector<Matrix>& calibration) {
+		if (source.empty() || calibration.empty()) {
+			throw std::invalid_argument("Quantization needs a network and calibration samples.");
+		}
+
+		// largest value seen at the input of every layer, and at the network input
+		std::vector<double> maxInput(source.size(), 0.0);
+		for (const auto& sample : calibration) {
+			Matrix current = sample.flatten();
+			if (*std::min_element(current.data(), current.data() + current.numRows()) < 0.0) {
+				throw std::invalid_argument("Quantized networks take non-negative inputs, a calibration sample has a negative value.");
+			}
+			for (size_t l = 0; l < source.size(); l++) {
+				const double* values = current.data();
+				for (size_t i = 0; i < current.numRows(); i++) {
+					maxInput[l] = std::max(maxInput[l], values[i]);
+				}
+				current = activate((source[l].weights * current) + source[l].biases, source[l].activation);
+			}
+		}
+
+		for (size_t l = 0; l < source.size(); l++) {
+			const Matrix& weights = source[l].weights;
+			QLayer layer;
+			layer.rows = weights.numRows();
+			layer.cols = weights.numCols();
+			layer.stride = (layer.cols + 63) & ~size_t(63); // zero padded to whole 64 byte blocks
+			layer.activation = source[l].activation;
+			layer.inputScale = static_cast<float>(maxInput[l] > 0.0 ? maxInput[l] / 127.0 : 1.0);
+			layer.weights.assign(layer.rows * layer.stride, 0);
+			layer.scales.resize(layer.rows);
+			layer.biases.resize(layer.rows);
+
+			for (size_t r = 0; r < layer.rows; r++) {
+				const double* row = weights[r];
+				double maxAbs = 0.0;
+				for (size_t c = 0; c < layer.cols; c++) {
+					maxAbs = std::max(maxAbs, std::fabs(row[c]));
+				}
+				double weightScale = maxAbs > 0.0 ? maxAbs / 127.0 : 1.0;
+				for (size_t c = 0; c < layer.cols; c++) {
+					layer.weights[r * layer.stride + c] = static_cast<int8_t>(std::max(-127.0, std::min(127.0, std::nearbyint(row[c] / weightScale))));
+				}
+				layer.scales[r] = static_cast<float>(weightScale * layer.inputScale); // int32 sum -> real value
+				layer.biases[r] = static_cast<float>(source[l].biases[r][0]);
+			}
+			layers.push_back(std::move(layer));
+		}
+
+		for (size_t l = 0; l + 1 < layers.size(); l++) {
+			layers[l].outputInvScale = 1.0f / layers[l + 1].inputScale;
+		}
+	}
+
+	size_t numInputs() const noexcept {
+		return layers.front().cols;
+	}
+
+	size_t numOutputs() const noexcept {
+		return layers.back().rows;
+	}
+
+	// activations of the last layer for one sample, any shape with numInputs() values, none negative
+	void predict(const Matrix& input, std::vector<float>& out) const {
+		if (input.numRows() * input.numCols() != numInputs()) {
+			throw std::invalid_argument("Input size does not match the quantized network.");
+		}
+
+		Scratch& scratch = scratchBuffers();
+		scratch.a.assign(layers.front().stride, 0);
+		const double* values = input.data();
+		const float invScale = 1.0f / layers.front().inputScale;
+		for (size_t i = 0; i < numInputs(); i++) {
+			if (values[i] < 0.0) {
+				throw std::invalid_argument("Quantized networks take non-negative inputs, input " + std::to_string(i) + " is negative.");
+			}
+			float q = static_cast<float>(values[i]) * invScale + 0.5f;
+			scratch.a[i] = static_cast<uint8_t>(std::min(127.0f, std::max(0.0f, q)));
+		}
+
+		out.resize(numOutputs());
+		for (size_t l = 0; l < layers.size(); l++) {
+			const bool last = l + 1 == layers.size();
+			if (!last) {
+				scratch.b.assign(layers[l + 1].stride, 0);
+			}
+			runLayer(layers[l], scratch.a.data(), last ? nullptr : scratch.b.data(), last ? out.data() : nullptr);
+			scratch.a.swap(scratch.b);
+		}
+	}
+
+	int classify(const Matrix& input) const {
+		std::vector<float>& out = scratchBuffers().out;
+		predict(input, out);
+		return static_cast<int>(std::max_element(out.begin(), out.end()) - out.begin());
+	}
+
+	// percentage of samples classified correctly
+	double eval(const std::vector<Matrix>& data, const std::vector<int>& targets) const {
+		size_t correct = 0;
+		for (size_t i = 0; i < data.size(); i++) {
+			correct += classify(data[i]) == targets[i];
+		}
+		return data.empty() ? 0.0 : 100.0 * correct / data.size();
+	}
+
+private:
+	struct QLayer {
+		size_t rows;
+		size_t cols;
+		size_t stride;
+		Activations activation;
+		float inputScale; // real value of one input step
+		float outputInvScale = 1.0f; // 1 / next layer's inputScale
+		std::vector<int8_t> weights; // rows x stride
+		std::vector<float> scales; // per row, weight scale * input scale
+		std::vector<float> biases;
+	};
+
+	std::vector<QLayer> layers;
+
+	struct Scratch {
+		std::vector<uint8_t> a;
+		std::vector<uint8_t> b;
+		std::vector<float> out;
+	};
+
+	// per thread, so concurrent predictions don't allocate after warming up
+	static Scratch& scratchBuffers() {
+		thread_local Scratch scratch;
+		return scratch;
+	}
+
+	// fused epilogue: rescale, bias, activation, then either requantize to u7 or write the float result
+	static void finish(const QLayer& layer, size_t r, int32_t acc, uint8_t* qOut, float* fOut) {
+		float y = acc * layer.scales[r] + layer.biases[r];
+		y = layer.activation == Activations::relu ? std::max(0.0f, y) : 1.0f / (1.0f + std::exp(-y));
+		if (fOut) {
+			fOut[r] = y;
+		}
+		else {
+			qOut[r] = static_cast<uint8_t>(std::min(127.0f, y * layer.outputInvScale + 0.5f));
+		}
+	}
+
+	static void runLayer(const QLayer& layer, const uint8_t* in, uint8_t* qOut, float* fOut) {
+		const size_t stride = layer.stride;
+		size_t r = 0;
+
+#if defined(__AVX512VNNI__) && defined(__AVX512F__)
+		// vpdpbusd: u8 x s8 products summed straight into int32 lanes
+		// (gcc/clang with -mavx512vnni; MSVC never defines __AVX512VNNI__, so its /arch:AVX2 builds use the path below)
+		for (; r + 4 <= layer.rows; r += 4) {
+			const int8_t* w = layer.weights.data() + r * stride;
+			__m512i acc0 = _mm512_setzero_si512(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+			for (size_t k = 0; k < stride; k += 64) {
+				__m512i a = _mm512_loadu_si512(in + k);
+				acc0 = _mm512_dpbusd_epi32(acc0, a, _mm512_loadu_si512(w + k));
+				acc1 = _mm512_dpbusd_epi32(acc1, a, _mm512_loadu_si512(w + stride + k));
+				acc2 = _mm512_dpbusd_epi32(acc2, a, _mm512_loadu_si512(w + 2 * stride + k));
+				acc3 = _mm512_dpbusd_epi32(acc3, a, _mm512_loadu_si512(w + 3 * stride + k));
+			}
+			finish(layer, r, _mm512_reduce_add_epi32(acc0), qOut, fOut);
+			finish(layer, r + 1, _mm512_reduce_add_epi32(acc1), qOut, fOut);
+			finish(layer, r + 2, _mm512_reduce_add_epi32(acc2), qOut, fOut);
+			finish(layer, r + 3, _mm512_reduce_add_epi32(acc3), qOut, fOut);
+		}
+#elif defined(__AVX2__)
+		// vpmaddubsw gives u8 x s8 pair sums in int16, vpmaddwd by 1 widens them to int32
+		// four rows at a time share every activation load
+		const __m256i ones = _mm256_set1_epi16(1);
+		for (; r + 4 <= layer.rows; r += 4) {
+			const int8_t* w = layer.weights.data() + r * stride;
+			__m256i acc0 = _mm256_setzero_si256(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+			for (size_t k = 0; k < stride; k += 32) {
+				__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + k));
+				acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_maddubs_epi16(a, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + k))), ones));
+				acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_maddubs_epi16(a, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + stride + k))), ones));
+				acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_maddubs_epi16(a, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + 2 * stride + k))), ones));
+				acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_maddubs_epi16(a, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + 3 * stride + k))), ones));
+			}
+			finish(layer, r, horizontalSum(acc0), qOut, fOut);
+			finish(layer, r + 1, horizontalSum(acc1), qOut, fOut);
+			finish(layer, r + 2, horizontalSum(acc2), qOut, fOut);
+			finish(layer, r + 3, horizontalSum(acc3), qOut, fOut);
+		}
+#endif
+
+		for (; r < layer.rows; r++) {
+			const int8_t* w = layer.weights.data() + r * stride;
+			int32_t acc = 0;
+			for (size_t k = 0; k < layer.cols; k++) {
+				acc += static_cast<int32_t>(in[k]) * w[k];
+			}
+			finish(layer, r, acc, qOut, fOut);
+		}
+	}
+
+#ifdef __AVX2__
+	static int32_t horizontalSum(__m256i v) {
+		__m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtsi128_si32(s);
+	}
+#endif
+};
+
+struct QuantizationReport {
+	double floatAccuracy;
+	double quantizedAccuracy;
+	double floatSamplesPerSecond;
+	double quantizedSamplesPerSecond;
+};
+
+// Quantizes model with the first calibrationSamples test samples, then compares accuracy and
+// single-thread throughput of the double and int8 paths over the whole test set.
+inline QuantizationReport reportQuantization(FFNN& model, const std::vector<Matrix>& testData, const std::vector<int>& targets, size_t calibrationSamples = 1000) {
+	std::vector<Matrix> calibration(testData.begin(), testData.begin() + std::min(calibrationSamples, testData.size()));
+	QuantizedFFNN quantized(model.getLayers(), calibration);
+
+	QuantizationReport report;
+	auto start = std::chrono::steady_clock::now();
+	std::vector<Matrix> outputs = model.forward(testData);
+	size_t correct = 0;
+	for (size_t i = 0; i < outputs.size(); i++) {
+		correct += model.getPrediction(outputs[i]) == targets[i];
+	}
+	report.floatAccuracy = testData.empty() ? 0.0 : 100.0 * correct / testData.size();
+	double floatSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	report.quantizedAccuracy = quantized.eval(testData, targets);
+	double quantizedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	report.floatSamplesPerSecond = testData.size() / floatSeconds;
+	report.quantizedSamplesPerSecond = testData.size() / quantizedSeconds;
+
+	std::printf("double: %.2f%% at %.0f samples/s\n", report.floatAccuracy, report.floatSamplesPerSecond);
+	std::printf("int8:   %.2f%% at %.0f samples/s (%+.2f points, %.1fx)\n", report.quantizedAccuracy, report.quantizedSamplesPerSecond,
+		report.quantizedAccuracy - report.floatAccuracy, report.quantizedSamplesPerSecond / report.floatSamplesPerSecond);
+	return report;
+}
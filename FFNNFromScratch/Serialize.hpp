@@ -2,77 +2,451 @@
 
 #include <fstream>
 #include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
 #include "Layer.hpp"
 #include "Matrix.hpp"
+#include "Checksum.hpp"
+#include "MappedFile.hpp"
+#include "ModelEncoding.hpp"
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <functional>
 
+// Model file layout (version 1):
+//   ModelFileHeader     64 bytes
+//   ModelLayerRecord    64 bytes per layer
+//   weight/bias blobs   row-major, each starting on a 64 byte boundary so they can be mapped in place
+// Blobs are encoded per layer (see ModelEncoding.hpp); uncompressed float64 blobs are plain doubles.
+// Files without the magic are the older raw format: per matrix (rows, cols) as size_t followed by doubles.
 
-void saveModel(const std::vector<Layer>& layers, const std::string& filename) {
+// where training stood when a checkpoint was written, all zero in plain model files
+struct TrainingState {
+	uint64_t epoch; // epoch to continue with
+	uint64_t batchInEpoch; // mini-batches of that epoch already trained
+	uint64_t step; // mini-batches trained in total
+	uint64_t shuffleSeed; // seeds the per-epoch shuffle, so a resumed epoch sees the same order
+};
+static_assert(sizeof(TrainingState) == 32, "training state fills the header's spare bytes");
+
+struct ModelFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t endianMarker; // reads back as 0x01020304 only on a host with the writer's byte order
+	uint32_t dtype; // ModelDType of the weights
+	uint32_t numLayers;
+	uint32_t checksum; // crc32 of everything after the header
+	uint64_t fileSize;
+	TrainingState training;
+};
+static_assert(sizeof(ModelFileHeader) == 64, "model file header must stay 64 bytes");
+
+struct ModelLayerRecord {
+	uint64_t rows; // weights are rows x cols, biases rows x 1
+	uint64_t cols;
+	uint32_t activation;
+	uint32_t dtype; // ModelDType of the weights
+	uint64_t weightsOffset;
+	uint64_t weightsBytes; // stored size, smaller than the decoded tensor when compressed
+	uint64_t biasesOffset;
+	uint64_t biasesBytes;
+	uint32_t compression; // ModelCompression of both blobs
+	uint32_t biasesDType; // int8 weights keep float32 biases
+};
+static_assert(sizeof(ModelLayerRecord) == 64, "model layer record must stay 64 bytes");
+
+const uint32_t modelFileVersion = 1;
+const uint32_t modelEndianMarker = 0x01020304;
+
+inline uint64_t alignModelOffset(uint64_t offset) {
+	return (offset + 63) & ~uint64_t(63);
+}
+
+struct ModelSaveOptions {
+	ModelDType dtype = ModelDType::float64;
+	ModelCompression compression = ModelCompression::none;
+};
+
+// runs fn(0) .. fn(count - 1) on up to one thread per core, rethrows the first failure
+inline void forEachLayerParallel(size_t count, const std::function<void(size_t)>& fn) {
+	size_t numThreads = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+	if (numThreads <= 1) {
+		for (size_t i = 0; i < count; i++) {
+			fn(i);
+		}
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	std::vector<std::exception_ptr> errors(numThreads);
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < numThreads; t++) {
+		threads.emplace_back([&, t] {
+			try {
+				for (size_t i = next++; i < count; i = next++) {
+					fn(i);
+				}
+			}
+			catch (...) {
+				errors[t] = std::current_exception();
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	for (auto& error : errors) {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+}
+
+inline bool isVersionedModelFile(const std::string& filename) {
+	std::ifstream file(filename, std::ios::binary);
+	char magic[4] = {};
+	file.read(magic, 4);
+	return file.gcount() == 4 && std::memcmp(magic, "FFNM", 4) == 0;
+}
+
+void saveModel(const std::vector<Layer>& layers, const std::string& filename,
+	const ModelSaveOptions& options = ModelSaveOptions(), const TrainingState& training = TrainingState())
+{
 	std::ofstream file(filename, std::ios::binary);
 	if (!file.is_open()) {
 		throw std::runtime_error("Unable to open file for saving model");
 	}
 
-	for (const auto& layer : layers) {
-		size_t rows = layer.weights.numRows();
-		size_t cols = layer.weights.numCols();
+	// plain doubles are written straight from the matrices, anything else is encoded per layer in parallel first
+	const ModelDType biasesDType = options.dtype == ModelDType::int8 ? ModelDType::float32 : options.dtype;
+	const bool raw = options.dtype == ModelDType::float64 && options.compression == ModelCompression::none;
+	std::vector<std::vector<uint8_t>> encoded(raw ? 0 : layers.size() * 2);
+	if (!raw) {
+		forEachLayerParallel(layers.size(), [&](size_t l) {
+			encoded[2 * l] = encodeTensor(layers[l].weights, options.dtype, options.compression);
+			encoded[2 * l + 1] = encodeTensor(layers[l].biases, biasesDType, options.compression);
+		});
+	}
+	auto blob = [&](size_t l, bool biases) {
+		const Matrix& m = biases ? layers[l].biases : layers[l].weights;
+		return raw ? reinterpret_cast<const char*>(m.data()) : reinterpret_cast<const char*>(encoded[2 * l + biases].data());
+	};
 
-		// save weights
-		file.write(reinterpret_cast<const char*>(&rows), sizeof(size_t));
-		file.write(reinterpret_cast<const char*>(&cols), sizeof(size_t));
-		for (size_t i = 0; i < rows; i++) {
-			for (size_t j = 0; j < cols; j++) {
-				file.write(reinterpret_cast<const char*>(&layer.weights[i][j]), sizeof(double));
-			}
-		}
+	// lay out the records and blobs first so the header can carry the final size
+	std::vector<ModelLayerRecord> records(layers.size());
+	uint64_t offset = alignModelOffset(sizeof(ModelFileHeader) + layers.size() * sizeof(ModelLayerRecord));
+	for (size_t l = 0; l < layers.size(); l++) {
+		ModelLayerRecord& record = records[l];
+		std::memset(&record, 0, sizeof(record));
+		record.rows = layers[l].weights.numRows();
+		record.cols = layers[l].weights.numCols();
+		record.activation = static_cast<uint32_t>(layers[l].activation);
+		record.dtype = static_cast<uint32_t>(options.dtype);
+		record.biasesDType = static_cast<uint32_t>(biasesDType);
+		record.compression = static_cast<uint32_t>(options.compression);
 
-		// save biases
-		rows = layer.biases.numRows();
-		cols = layer.biases.numCols();
+		record.weightsOffset = offset;
+		record.weightsBytes = raw ? record.rows * record.cols * sizeof(double) : encoded[2 * l].size();
+		offset = alignModelOffset(offset + record.weightsBytes);
 
-		file.write(reinterpret_cast<const char*>(&rows), sizeof(size_t));
-		file.write(reinterpret_cast<const char*>(&cols), sizeof(size_t));
-		for (size_t i = 0; i < rows; i++) {
-			for (size_t j = 0; j < cols; j++) {
-				file.write(reinterpret_cast<const char*>(&layer.biases[i][j]), sizeof(double));
-			}
-		}
+		record.biasesOffset = offset;
+		record.biasesBytes = raw ? record.rows * sizeof(double) : encoded[2 * l + 1].size();
+		offset = alignModelOffset(offset + record.biasesBytes);
+	}
+
+	ModelFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "FFNM", 4);
+	header.version = modelFileVersion;
+	header.endianMarker = modelEndianMarker;
+	header.dtype = static_cast<uint32_t>(options.dtype);
+	header.numLayers = static_cast<uint32_t>(layers.size());
+	header.fileSize = offset;
+	header.training = training;
+
+	// the checksum is filled in once everything after the header has been written
+	uint32_t crc = 0;
+	uint64_t position = sizeof(ModelFileHeader);
+	const char zeros[64] = {};
+	auto put = [&](const char* data, size_t bytes) {
+		file.write(data, bytes);
+		crc = crc32Update(crc, reinterpret_cast<const uint8_t*>(data), bytes);
+		position += bytes;
+	};
+	auto padTo = [&](uint64_t target) {
+		put(zeros, static_cast<size_t>(target - position));
+	};
 
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	put(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(ModelLayerRecord));
+
+	for (size_t l = 0; l < layers.size(); l++) {
+		// one write per tensor
+		padTo(records[l].weightsOffset);
+		put(blob(l, false), records[l].weightsBytes);
+
+		padTo(records[l].biasesOffset);
+		put(blob(l, true), records[l].biasesBytes);
+	}
+	padTo(header.fileSize);
+
+	header.checksum = crc;
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!file) {
+		throw std::runtime_error("Failed writing model file");
 	}
 	file.close();
 }
 
-void loadModel(std::vector<Layer>& layers, const std::string& filename) {
+// older raw format: (rows, cols) then doubles for every weight and bias matrix, no topology header
+std::vector<Layer> readLegacyModel(const std::string& filename) {
 	std::ifstream file(filename, std::ios::binary);
 	if (!file.is_open()) {
 		throw std::runtime_error("Unable to open file for loading model");
 	}
 
-	for (auto& layer : layers) {
+	auto readMatrix = [&](Matrix& m) {
 		size_t rows, cols;
-
-		// load weights
-		file.read(reinterpret_cast<char*>(&rows), sizeof(size_t));
+		if (!file.read(reinterpret_cast<char*>(&rows), sizeof(size_t))) {
+			return false;
+		}
 		file.read(reinterpret_cast<char*>(&cols), sizeof(size_t));
 
-		Matrix weights(rows, cols);
-		for (size_t i = 0; i < rows; i++) {
-			for (size_t j = 0; j < cols; j++) {
-				file.read(reinterpret_cast<char*>(&weights[i][j]), sizeof(double));
-			}
+		m = Matrix(rows, cols);
+		file.read(reinterpret_cast<char*>(m.data()), rows * cols * sizeof(double));
+		if (!file) {
+			throw std::runtime_error("Truncated model file");
 		}
-		layer.weights = weights;
+		return true;
+	};
 
-		// load biases
-		file.read(reinterpret_cast<char*>(&rows), sizeof(size_t));
-		file.read(reinterpret_cast<char*>(&cols), sizeof(size_t));
+	std::vector<Layer> layers;
+	Matrix weights, biases;
+	while (readMatrix(weights)) {
+		if (!readMatrix(biases)) {
+			throw std::runtime_error("Truncated model file");
+		}
+		layers.emplace_back(weights, biases, Activations::sigmoid);
+	}
+	return layers;
+}
 
-		Matrix biases(rows, cols);
-		for (size_t i = 0; i < rows; i++) {
-			for (size_t j = 0; j < cols; j++) {
-				file.read(reinterpret_cast<char*>(&biases[i][j]), sizeof(double));
-			}
+struct ModelLayout {
+	ModelFileHeader header;
+	std::vector<ModelLayerRecord> records;
+};
+
+// validates the header and layer table of a versioned model file held in memory
+inline ModelLayout parseModelLayout(const uint8_t* bytes, size_t size, bool verifyChecksum) {
+	ModelLayout layout;
+	ModelFileHeader& header = layout.header;
+	if (size < sizeof(header)) {
+		throw std::runtime_error("Truncated model file");
+	}
+	std::memcpy(&header, bytes, sizeof(header));
+	if (std::memcmp(header.magic, "FFNM", 4) != 0) {
+		throw std::runtime_error("Incorrect model file magic");
+	}
+	if (header.version != modelFileVersion) {
+		throw std::runtime_error("Unsupported model file version: " + std::to_string(header.version));
+	}
+	if (header.endianMarker != modelEndianMarker) {
+		throw std::runtime_error("Model file was written with a different byte order");
+	}
+	if (header.fileSize != size) {
+		throw std::runtime_error("Model file size does not match its header");
+	}
+	if (verifyChecksum && crc32Update(0, bytes + sizeof(header), size - sizeof(header)) != header.checksum) {
+		throw std::runtime_error("Model file checksum mismatch");
+	}
+	if (sizeof(header) + header.numLayers * sizeof(ModelLayerRecord) > size) {
+		throw std::runtime_error("Truncated model file");
+	}
+
+	layout.records.resize(header.numLayers);
+	for (uint32_t l = 0; l < header.numLayers; l++) {
+		ModelLayerRecord& record = layout.records[l];
+		std::memcpy(&record, bytes + sizeof(header) + l * sizeof(ModelLayerRecord), sizeof(record));
+		if (record.dtype > static_cast<uint32_t>(ModelDType::int8) || record.biasesDType > static_cast<uint32_t>(ModelDType::int8)) {
+			throw std::runtime_error("Unsupported weight dtype in model file: " + std::to_string(record.dtype));
+		}
+		if (record.compression > static_cast<uint32_t>(ModelCompression::shuffleHuffman)) {
+			throw std::runtime_error("Unsupported compression in model file: " + std::to_string(record.compression));
+		}
+		if (record.activation > static_cast<uint32_t>(Activations::relu)) {
+			throw std::runtime_error("Unknown activation in model file: " + std::to_string(record.activation));
+		}
+		// each layer takes the previous one's outputs; the 2^31 cap keeps the size arithmetic below from overflowing
+		if (record.rows == 0 || record.cols == 0 || record.rows >= (uint64_t(1) << 31) || record.cols >= (uint64_t(1) << 31)
+			|| (l > 0 && record.cols != layout.records[l - 1].rows)) {
+			throw std::runtime_error("Layer " + std::to_string(l) + " of the model file has an invalid shape: "
+				+ std::to_string(record.rows) + " x " + std::to_string(record.cols));
+		}
+
+		// a compressed blob can only expand so far: an lz sequence turns a 255 length byte into 255
+		// bytes, a huffman code is at least one bit per byte, so larger claimed tensors are corrupt
+		const bool compressed = record.compression != static_cast<uint32_t>(ModelCompression::none);
+		const uint64_t weightBytes = encodedTensorBytes(static_cast<ModelDType>(record.dtype), record.rows, record.cols);
+		const uint64_t biasBytes = encodedTensorBytes(static_cast<ModelDType>(record.biasesDType), record.rows, 1);
+		const uint64_t maxRatio = record.compression == static_cast<uint32_t>(ModelCompression::shuffleLz) ? 256 : 8;
+		if ((!compressed && (record.weightsBytes != weightBytes || record.biasesBytes != biasBytes))
+			|| (compressed && (weightBytes / maxRatio > record.weightsBytes || biasBytes / maxRatio > record.biasesBytes))
+			|| record.weightsOffset % 64 != 0 || record.biasesOffset % 64 != 0
+			|| record.weightsBytes > size || record.weightsOffset > size - record.weightsBytes
+			|| record.biasesBytes > size || record.biasesOffset > size - record.biasesBytes) {
+			throw std::runtime_error("Corrupt layer record in model file");
 		}
-		layer.biases = biases;
 	}
-	file.close();
-}
\ No newline at end of file
+	return layout;
+}
+
+// reads a model file into freshly built layers, topology and activations come from the file
+// tensors are read straight into their matrices, one read per tensor, checksummed on the way
+std::vector<Layer> readModel(const std::string& filename) {
+	if (!isVersionedModelFile(filename)) {
+		return readLegacyModel(filename);
+	}
+
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		throw std::runtime_error("Unable to open file for loading model");
+	}
+	const uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+	file.seekg(0);
+
+	// header and layer table first, parseModelLayout only looks at those without the checksum pass
+	ModelFileHeader header;
+	if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+		throw std::runtime_error("Truncated model file");
+	}
+	uint64_t tableBytes = std::min<uint64_t>(uint64_t(header.numLayers) * sizeof(ModelLayerRecord), fileSize - sizeof(header));
+	std::vector<char> table(sizeof(header) + tableBytes);
+	std::memcpy(table.data(), &header, sizeof(header));
+	file.read(table.data() + sizeof(header), tableBytes);
+	ModelLayout layout = parseModelLayout(reinterpret_cast<const uint8_t*>(table.data()), fileSize, false);
+
+	uint32_t crc = crc32Update(0, reinterpret_cast<const uint8_t*>(table.data() + sizeof(header)), tableBytes);
+	uint64_t position = table.size();
+	std::vector<char> gap;
+	auto get = [&](char* dst, uint64_t offset, uint64_t bytes) {
+		if (offset < position) {
+			throw std::runtime_error("Corrupt layer record in model file");
+		}
+		gap.resize(static_cast<size_t>(offset - position));
+		file.read(gap.data(), gap.size());
+		crc = crc32Update(crc, reinterpret_cast<const uint8_t*>(gap.data()), gap.size());
+		file.read(dst, bytes);
+		crc = crc32Update(crc, reinterpret_cast<const uint8_t*>(dst), bytes);
+		position = offset + bytes;
+	};
+
+	// plain double tensors land directly in their matrices, encoded ones are staged and decoded afterwards
+	const size_t numLayers = layout.records.size();
+	std::vector<Matrix> weights(numLayers), biases(numLayers);
+	std::vector<std::vector<uint8_t>> stored(numLayers * 2);
+	auto fetch = [&](Matrix& m, std::vector<uint8_t>& staging, ModelDType dtype, ModelCompression compression, uint64_t offset, uint64_t bytes) {
+		if (dtype == ModelDType::float64 && compression == ModelCompression::none) {
+			get(reinterpret_cast<char*>(m.data()), offset, bytes);
+		}
+		else {
+			staging.resize(static_cast<size_t>(bytes));
+			get(reinterpret_cast<char*>(staging.data()), offset, bytes);
+		}
+	};
+
+	for (size_t l = 0; l < numLayers; l++) {
+		const ModelLayerRecord& record = layout.records[l];
+		const ModelCompression compression = static_cast<ModelCompression>(record.compression);
+		weights[l] = Matrix(record.rows, record.cols);
+		fetch(weights[l], stored[2 * l], static_cast<ModelDType>(record.dtype), compression, record.weightsOffset, record.weightsBytes);
+
+		biases[l] = Matrix(record.rows, 1);
+		fetch(biases[l], stored[2 * l + 1], static_cast<ModelDType>(record.biasesDType), compression, record.biasesOffset, record.biasesBytes);
+	}
+	char tail[64];
+	get(tail, fileSize, 0);
+	if (!file || crc != header.checksum) {
+		throw std::runtime_error("Model file checksum mismatch");
+	}
+
+	// decoding is independent per layer, so layers decode in parallel
+	forEachLayerParallel(numLayers, [&](size_t l) {
+		const ModelLayerRecord& record = layout.records[l];
+		const ModelCompression compression = static_cast<ModelCompression>(record.compression);
+		if (!stored[2 * l].empty()) {
+			decodeTensor(stored[2 * l].data(), stored[2 * l].size(), static_cast<ModelDType>(record.dtype), compression, weights[l]);
+		}
+		if (!stored[2 * l + 1].empty()) {
+			decodeTensor(stored[2 * l + 1].data(), stored[2 * l + 1].size(), static_cast<ModelDType>(record.biasesDType), compression, biases[l]);
+		}
+	});
+
+	std::vector<Layer> layers;
+	for (size_t l = 0; l < numLayers; l++) {
+		layers.emplace_back(std::move(weights[l]), std::move(biases[l]), static_cast<Activations>(layout.records[l].activation));
+	}
+	return layers;
+}
+
+// Inference load path: maps the file read-only and points every layer's weights and biases into
+// the mapping, so nothing is copied and all processes serving the same file share its page cache.
+// The mapping lives as long as any layer (or copy of one) still views it. Writing to a mapped
+// layer (e.g. training it further) gives that matrix a private copy first.
+// The checksum pass reads every page, so it is opt-in here. Only plain float64 files can be mapped.
+std::vector<Layer> mapModel(const std::string& filename, bool verifyChecksum = false) {
+	if (!isVersionedModelFile(filename)) {
+		return readLegacyModel(filename); // the raw format isn't aligned for mapping, copy it instead
+	}
+
+	std::shared_ptr<const MappedFile> mapping = std::make_shared<MappedFile>(filename);
+	const uint8_t* base = mapping->data();
+	ModelLayout layout = parseModelLayout(base, mapping->size(), verifyChecksum);
+	for (const auto& record : layout.records) {
+		if (record.dtype != static_cast<uint32_t>(ModelDType::float64) || record.biasesDType != static_cast<uint32_t>(ModelDType::float64)
+			|| record.compression != static_cast<uint32_t>(ModelCompression::none)) {
+			return readModel(filename); // encoded weights have to be decoded into memory anyway
+		}
+	}
+
+	std::vector<Layer> layers;
+	for (const auto& record : layout.records) {
+		Matrix weights = Matrix::view(record.rows, record.cols, reinterpret_cast<const double*>(base + record.weightsOffset), mapping);
+		Matrix biases = Matrix::view(record.rows, 1, reinterpret_cast<const double*>(base + record.biasesOffset), mapping);
+		layers.emplace_back(std::move(weights), std::move(biases), static_cast<Activations>(record.activation));
+	}
+	return layers;
+}
+
+// training progress stored in a checkpoint, zero for plain and legacy model files
+TrainingState readTrainingState(const std::string& filename) {
+	TrainingState training = TrainingState();
+	if (isVersionedModelFile(filename)) {
+		std::ifstream file(filename, std::ios::binary);
+		ModelFileHeader header;
+		if (file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+			training = header.training;
+		}
+	}
+	return training;
+}
+
+// loads a model file into an existing network, whose topology has to match the file
+void loadModel(std::vector<Layer>& layers, const std::string& filename) {
+	std::vector<Layer> loaded = readModel(filename);
+	if (loaded.size() != layers.size()) {
+		throw std::runtime_error("Model file has " + std::to_string(loaded.size()) + " layers, network has " + std::to_string(layers.size()));
+	}
+
+	for (size_t l = 0; l < layers.size(); l++) {
+		if (loaded[l].weights.size() != layers[l].weights.size()) {
+			throw std::runtime_error("Layer " + std::to_string(l) + " shape in model file does not match the network");
+		}
+		layers[l].weights = std::move(loaded[l].weights);
+		layers[l].biases = std::move(loaded[l].biases);
+		layers[l].activation = loaded[l].activation;
+	}
+}
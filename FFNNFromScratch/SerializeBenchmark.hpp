@@ -0,0 +1,112 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Layer.hpp"
+#include "Serialize.hpp"
+
+struct SerializeTiming {
+	size_t parameters;
+	double elementSaveMs; // one stream call per double, how models used to be written
+	double elementLoadMs;
+	double bulkSaveMs; // saveModel, one write per tensor
+	double bulkLoadMs; // readModel, one read per tensor
+	double mappedLoadMs; // mapModel, no copy at all
+};
+
+namespace serialize_benchmark {
+	inline double millisecondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// reference per-element writer/reader in the legacy raw layout, kept only to compare against
+	inline void saveElementwise(const std::vector<Layer>& layers, const std::string& filename) {
+		std::ofstream file(filename, std::ios::binary);
+		auto writeMatrix = [&](const Matrix& m) {
+			size_t rows = m.numRows(), cols = m.numCols();
+			file.write(reinterpret_cast<const char*>(&rows), sizeof(size_t));
+			file.write(reinterpret_cast<const char*>(&cols), sizeof(size_t));
+			for (size_t i = 0; i < rows; i++) {
+				for (size_t j = 0; j < cols; j++) {
+					file.write(reinterpret_cast<const char*>(&m[i][j]), sizeof(double));
+				}
+			}
+		};
+		for (const auto& layer : layers) {
+			writeMatrix(layer.weights);
+			writeMatrix(layer.biases);
+		}
+	}
+
+	inline std::vector<Matrix> loadElementwise(const std::string& filename) {
+		std::ifstream file(filename, std::ios::binary);
+		std::vector<Matrix> matrices;
+		size_t rows, cols;
+		while (file.read(reinterpret_cast<char*>(&rows), sizeof(size_t))) {
+			file.read(reinterpret_cast<char*>(&cols), sizeof(size_t));
+			Matrix m(rows, cols);
+			for (size_t i = 0; i < rows; i++) {
+				for (size_t j = 0; j < cols; j++) {
+					file.read(reinterpret_cast<char*>(&m[i][j]), sizeof(double));
+				}
+			}
+			matrices.push_back(std::move(m));
+		}
+		return matrices;
+	}
+}
+
+// Times saving and loading one network of the given topology with every path.
+// Loads run right after the save, so they measure a warm page cache, i.e. the cost of the I/O calls and copies.
+inline SerializeTiming benchmarkSerialization(const std::vector<size_t>& layerSizes, const std::string& directory = ".") {
+	using namespace serialize_benchmark;
+
+	std::vector<Layer> layers;
+	SerializeTiming timing = {};
+	for (size_t i = 1; i < layerSizes.size(); i++) {
+		layers.emplace_back(layerSizes[i], layerSizes[i - 1]);
+		timing.parameters += layerSizes[i] * layerSizes[i - 1] + layerSizes[i];
+	}
+
+	const std::string elementPath = directory + "/bench_elementwise.dat";
+	const std::string bulkPath = directory + "/bench_bulk.dat";
+
+	auto start = std::chrono::steady_clock::now();
+	saveElementwise(layers, elementPath);
+	timing.elementSaveMs = millisecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	loadElementwise(elementPath);
+	timing.elementLoadMs = millisecondsSince(start);
+	std::remove(elementPath.c_str());
+
+	start = std::chrono::steady_clock::now();
+	saveModel(layers, bulkPath);
+	timing.bulkSaveMs = millisecondsSince(start);
+	layers.clear(); // keep peak memory at two copies of the network for the 100M case
+
+	start = std::chrono::steady_clock::now();
+	readModel(bulkPath);
+	timing.bulkLoadMs = millisecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	mapModel(bulkPath);
+	timing.mappedLoadMs = millisecondsSince(start);
+	std::remove(bulkPath.c_str());
+
+	return timing;
+}
+
+// save/load comparison for a 1M and a 100M parameter network (the latter needs ~1.6 GB of memory and disk)
+inline void runSerializationBenchmark(const std::string& directory = ".") {
+	const std::vector<std::vector<size_t>> topologies = { { 1000, 1000 }, { 10000, 10000 } };
+
+	std::printf("%12s %14s %14s %12s %12s %12s\n", "parameters", "elem save ms", "elem load ms", "save ms", "load ms", "map ms");
+	for (const auto& topology : topologies) {
+		SerializeTiming t = benchmarkSerialization(topology, directory);
+		std::printf("%12zu %14.1f %14.1f %12.1f %12.1f %12.3f\n", t.parameters, t.elementSaveMs, t.elementLoadMs, t.bulkSaveMs, t.bulkLoadMs, t.mappedLoadMs);
+	}
+}
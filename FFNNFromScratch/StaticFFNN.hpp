@@ -0,0 +1,226 @@
+#pragma once
+#include <array>
+#include <tuple>
+#include <span>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include "Layer.hpp"
+#include "Serialize.hpp"
+#include "InferenceSession.hpp"
+#include "LatencyBenchmark.hpp"
+#include "FFNN.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// one dense layer with compile-time shape, weights row-major
+template <size_t In, size_t Out>
+struct StaticLayer {
+	alignas(32) std::array<float, Out * In> weights;
+	std::array<float, Out> biases;
+	Activations activation;
+
+	void forward(const float* in, float* out) const {
+		// four rows per pass share each input load in registers; the portable loop keeps one row so its
+		// partial sums don't spill
+#ifdef __AVX2__
+		constexpr size_t block = 4;
+#else
+		constexpr size_t block = 1;
+#endif
+		constexpr size_t blockRows = Out - Out % block;
+		for (size_t r = 0; r < blockRows; r += block) {
+			rows<block>(in, out, r);
+		}
+		if constexpr (Out % block != 0) {
+			for (size_t r = blockRows; r < Out; r++) {
+				rows<1>(in, out, r);
+			}
+		}
+	}
+
+	// R rows at once, eight independent partial sums per row so the inner loop maps onto vector lanes
+	// without reassociating a single sum
+	template <size_t R>
+	void rows(const float* in, float* out, size_t first) const {
+		constexpr size_t body = In - In % 8;
+		float acc[R][8] = {};
+#ifdef __AVX2__
+		__m256 sum[R];
+		for (size_t i = 0; i < R; i++) {
+			sum[i] = _mm256_setzero_ps();
+		}
+		const float* w = weights.data() + first * In;
+		for (size_t k = 0; k < body; k += 8) {
+			__m256 x = _mm256_loadu_ps(in + k);
+			// unrolled at compile time so the R accumulators stay in registers
+			[&]<size_t... I>(std::index_sequence<I...>) {
+				((sum[I] = _mm256_add_ps(sum[I], _mm256_mul_ps(x, _mm256_loadu_ps(w + I * In + k)))), ...);
+			}(std::make_index_sequence<R>());
+		}
+		for (size_t i = 0; i < R; i++) {
+			_mm256_storeu_ps(acc[i], sum[i]);
+		}
+#else
+		for (size_t k = 0; k < body; k += 8) {
+			for (size_t i = 0; i < R; i++) {
+				const float* w = weights.data() + (first + i) * In + k;
+				for (size_t j = 0; j < 8; j++) {
+					acc[i][j] += w[j] * in[k + j];
+				}
+			}
+		}
+#endif
+		for (size_t i = 0; i < R; i++) {
+			const float* w = weights.data() + (first + i) * In;
+			for (size_t k = body; k < In; k++) {
+				acc[i][k - body] += w[k] * in[k];
+			}
+
+			float z = ((acc[i][0] + acc[i][1]) + (acc[i][2] + acc[i][3])) + ((acc[i][4] + acc[i][5]) + (acc[i][6] + acc[i][7])) + biases[first + i];
+			out[first + i] = activation == Activations::relu ? std::max(0.0f, z) : 1.0f / (1.0f + std::exp(-z));
+		}
+	}
+};
+
+// Feed-forward network whose topology is part of the type, e.g. StaticFFNN<784, 128, 64, 10>.
+// Every loop bound is a constant, activations live in fixed-size arrays on the stack and nothing is
+// checked at run time. Weights are read from and written back to the runtime Layer / model file format.
+// It is not faster than InferenceSession (benchmarkStaticLatency puts them within run-to-run noise,
+// loading the weights dominates either way); what it buys is shape errors at compile time and an
+// inference path with no heap state.
+template <size_t... Sizes>
+class StaticFFNN {
+	static_assert(sizeof...(Sizes) >= 2, "a network needs at least an input and an output size");
+
+public:
+	static constexpr std::array<size_t, sizeof...(Sizes)> sizes = { Sizes... };
+	static constexpr size_t numLayers = sizeof...(Sizes) - 1;
+	static constexpr size_t numInputs = sizes.front();
+	static constexpr size_t numOutputs = sizes.back();
+
+	// shapes must match the template arguments exactly
+	static StaticFFNN fromLayers(const std::vector<Layer>& layers) {
+		if (layers.size() != numLayers) {
+			throw std::invalid_argument("Expected " + std::to_string(numLayers) + " layers, got " + std::to_string(layers.size()));
+		}
+		StaticFFNN result;
+		result.load(layers, std::make_index_sequence<numLayers>());
+		return result;
+	}
+
+	static StaticFFNN fromFile(const std::string& filename) {
+		return fromLayers(readModel(filename));
+	}
+
+	// back to runtime layers, e.g. for saveModel
+	std::vector<Layer> toLayers() const {
+		std::vector<Layer> layers;
+		store(layers, std::make_index_sequence<numLayers>());
+		return layers;
+	}
+
+	void predict(std::span<const float, numInputs> input, std::span<float, numOutputs> output) const {
+		forwardFrom<0>(input.data(), output.data());
+	}
+
+	int classify(std::span<const float, numInputs> input) const {
+		std::array<float, numOutputs> output;
+		predict(input, output);
+		return static_cast<int>(std::max_element(output.begin(), output.end()) - output.begin());
+	}
+
+private:
+	template <size_t... L>
+	static auto layerTypes(std::index_sequence<L...>) -> std::tuple<StaticLayer<sizes[L], sizes[L + 1]>...>;
+
+	using Parameters = decltype(layerTypes(std::make_index_sequence<numLayers>()));
+
+	// the 784 x 128 layer alone is 400 KB, so the weights live on the heap and the network stays cheap to move
+	std::unique_ptr<Parameters> params = std::make_unique<Parameters>();
+
+	template <size_t L>
+	void forwardFrom(const float* in, float* out) const {
+		if constexpr (L + 1 == numLayers) {
+			std::get<L>(*params).forward(in, out);
+		}
+		else {
+			alignas(32) std::array<float, sizes[L + 1]> next;
+			std::get<L>(*params).forward(in, next.data());
+			forwardFrom<L + 1>(next.data(), out);
+		}
+	}
+
+	template <size_t... L>
+	void load(const std::vector<Layer>& layers, std::index_sequence<L...>) {
+		(loadLayer(layers[L], std::get<L>(*params), L), ...);
+	}
+
+	template <size_t In, size_t Out>
+	static void loadLayer(const Layer& layer, StaticLayer<In, Out>& target, size_t index) {
+		if (layer.weights.numRows() != Out || layer.weights.numCols() != In || layer.biases.numRows() != Out) {
+			throw std::invalid_argument("Layer " + std::to_string(index) + " shape does not match the static topology.");
+		}
+		const double* weights = layer.weights.data();
+		for (size_t i = 0; i < Out * In; i++) {
+			target.weights[i] = static_cast<float>(weights[i]);
+		}
+		for (size_t r = 0; r < Out; r++) {
+			target.biases[r] = static_cast<float>(layer.biases[r][0]);
+		}
+		target.activation = layer.activation;
+	}
+
+	template <size_t... L>
+	void store(std::vector<Layer>& layers, std::index_sequence<L...>) const {
+		(storeLayer(layers, std::get<L>(*params)), ...);
+	}
+
+	template <size_t In, size_t Out>
+	static void storeLayer(std::vector<Layer>& layers, const StaticLayer<In, Out>& source) {
+		Matrix weights(Out, In);
+		Matrix biases(Out, 1);
+		std::copy(source.weights.begin(), source.weights.end(), weights.data());
+		std::copy(source.biases.begin(), source.biases.end(), biases.data());
+		layers.emplace_back(std::move(weights), std::move(biases), source.activation);
+	}
+};
+
+// Single-sample latency of the three inference paths on the same weights: FFNN::forward,
+// InferenceSession (runtime shapes, no allocation) and StaticFFNN. Prints mean and median per sample.
+template <size_t... Sizes>
+void benchmarkStaticLatency(FFNN& model, const StaticFFNN<Sizes...>& fixed, const std::vector<Matrix>& samples) {
+	constexpr size_t numInputs = StaticFFNN<Sizes...>::numInputs;
+	constexpr size_t numOutputs = StaticFFNN<Sizes...>::numOutputs;
+	std::vector<float> inputs(samples.size() * numInputs);
+	for (size_t i = 0; i < samples.size(); i++) {
+		std::copy(samples[i].data(), samples[i].data() + numInputs, inputs.begin() + i * numInputs);
+	}
+
+	auto measure = [&](const char* name, auto&& runOne) {
+		printCallLatency(name, 18, samples.size(), runOne);
+	};
+
+	std::vector<Matrix> single(1);
+	measure("FFNN::forward", [&](size_t i) {
+		single[0] = samples[i];
+		model.forward(single);
+	});
+
+	InferenceSession session(model.compile());
+	std::array<float, numOutputs> output;
+	measure("InferenceSession", [&](size_t i) {
+		session.run(std::span<const float>(inputs.data() + i * numInputs, numInputs), output);
+	});
+
+	measure("StaticFFNN", [&](size_t i) {
+		fixed.predict(std::span<const float, numInputs>(inputs.data() + i * numInputs, numInputs), output);
+	});
+}
@@ -0,0 +1,229 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+#include "Matrix.hpp"
+#include "Idx.hpp"
+
+// sequential source of training samples for data that doesn't fit in memory
+// each epoch visits every sample once, in an order decided by the seed
+class StreamingDataset {
+public:
+	virtual ~StreamingDataset() = default;
+
+	// samples per epoch
+	virtual size_t size() const = 0;
+
+	virtual void beginEpoch(uint64_t seed) = 0;
+
+	// writes the next sample of the epoch, returns false once the epoch is exhausted
+	virtual bool next(Matrix& out, int& label) = 0;
+};
+
+// Streams image/label IDX pairs (raw or gzip) with bounded memory.
+// Every file pair is cut into shards of shardItems samples (a compressed file can't seek, so it is
+// one shard), the shard order is shuffled per epoch and samples are drawn at random from a window
+// of windowSize samples that is topped up as it drains. Memory use is the window plus one read chunk.
+class StreamingIdxDataset : public StreamingDataset {
+public:
+	StreamingIdxDataset(const std::vector<std::string>& imageFiles, const std::vector<std::string>& labelFiles,
+		size_t windowSize = 4096, size_t shardItems = 8192) :
+		imageFiles(imageFiles), labelFiles(labelFiles), windowSize(std::max<size_t>(windowSize, 1)), shardItems(std::max<size_t>(shardItems, 1))
+	{
+		if (imageFiles.size() != labelFiles.size() || imageFiles.empty()) {
+			throw std::invalid_argument("Need one label file per image file.");
+		}
+
+		// read every header up front so size() and the sample shape are known before streaming
+		for (size_t f = 0; f < imageFiles.size(); f++) {
+			IdxReader images(imageFiles[f]);
+			IdxReader labels(labelFiles[f]);
+			const IdxHeader& imageHeader = images.header();
+			size_t fileRows = 0;
+			size_t fileCols = 0;
+			try {
+				imageHeader.imageShape(fileRows, fileCols);
+			}
+			catch (const std::runtime_error& ex) {
+				throw std::runtime_error(imageFiles[f] + ": " + ex.what());
+			}
+			if (!labels.header().isLabelColumn()) {
+				throw std::runtime_error(labelFiles[f] + " must be a 1-dimensional integer IDX file.");
+			}
+			if (imageHeader.numItems() != labels.header().numItems()) {
+				throw std::runtime_error("Number of images does not match number of labels in " + imageFiles[f]);
+			}
+
+			if (f == 0) {
+				rows = fileRows;
+				cols = fileCols;
+			}
+			else if (fileRows != rows || fileCols != cols) {
+				throw std::runtime_error("Sample shape of " + imageFiles[f] + " does not match the first file.");
+			}
+			fileScale.push_back(imageHeader.type == IdxType::uint8 ? 1.0 / 255.0 : 1.0);
+
+			// split seekable files into shards, compressed ones are read whole
+			size_t numItems = imageHeader.numItems();
+			size_t step = isGzipFile(imageFiles[f]) || isGzipFile(labelFiles[f]) ? std::max<size_t>(numItems, 1) : shardItems;
+			for (size_t begin = 0; begin < numItems; begin += step) {
+				shards.push_back({ f, begin, std::min(begin + step, numItems) });
+			}
+			totalItems += numItems;
+		}
+
+		windowData.resize(this->windowSize * rows * cols);
+		windowLabels.resize(this->windowSize);
+	}
+
+	size_t size() const override {
+		return totalItems;
+	}
+
+	void beginEpoch(uint64_t seed) override {
+		gen.seed(seed);
+		shardOrder.resize(shards.size());
+		for (size_t i = 0; i < shardOrder.size(); i++) {
+			shardOrder[i] = i;
+		}
+		std::shuffle(shardOrder.begin(), shardOrder.end(), gen);
+
+		nextShard = 0;
+		shardRemaining = 0;
+		imageReader.reset();
+		labelReader.reset();
+		chunkPos = chunkCount = 0;
+
+		// prime the shuffle window
+		windowCount = 0;
+		while (windowCount < windowSize && readSample(&windowData[windowCount * rows * cols], windowLabels[windowCount])) {
+			windowCount++;
+		}
+	}
+
+	bool next(Matrix& out, int& label) override {
+		if (windowCount == 0) {
+			return false;
+		}
+
+		const size_t sampleSize = rows * cols;
+		size_t pick = std::uniform_int_distribution<size_t>(0, windowCount - 1)(gen);
+		const float* sample = &windowData[pick * sampleSize];
+
+		if (out.numRows() != rows || out.numCols() != cols) {
+			out = Matrix(rows, cols);
+		}
+		for (size_t i = 0; i < rows; i++) {
+			for (size_t j = 0; j < cols; j++) {
+				out[i][j] = sample[i * cols + j];
+			}
+		}
+		label = windowLabels[pick];
+
+		// refill the slot from the stream, or shrink the window once the stream is drained
+		if (!readSample(&windowData[pick * sampleSize], windowLabels[pick])) {
+			windowCount--;
+			std::copy(&windowData[windowCount * sampleSize], &windowData[windowCount * sampleSize] + sampleSize, &windowData[pick * sampleSize]);
+			windowLabels[pick] = windowLabels[windowCount];
+		}
+		return true;
+	}
+
+	size_t numRows() const noexcept {
+		return rows;
+	}
+
+	size_t numCols() const noexcept {
+		return cols;
+	}
+
+private:
+	struct Shard {
+		size_t file;
+		size_t begin;
+		size_t end;
+	};
+
+	std::vector<std::string> imageFiles;
+	std::vector<std::string> labelFiles;
+	std::vector<double> fileScale;
+	size_t windowSize;
+	size_t shardItems;
+	size_t rows = 0;
+	size_t cols = 0;
+	size_t totalItems = 0;
+
+	std::vector<Shard> shards;
+	std::vector<size_t> shardOrder;
+	size_t nextShard = 0;
+	size_t shardRemaining = 0;
+	double currentScale = 1.0;
+	std::unique_ptr<IdxReader> imageReader;
+	std::unique_ptr<IdxReader> labelReader;
+
+	// chunk of raw samples read from the current shard
+	std::vector<float> chunkData;
+	std::vector<int> chunkLabels;
+	size_t chunkPos = 0;
+	size_t chunkCount = 0;
+
+	// shuffle window
+	std::vector<float> windowData;
+	std::vector<int> windowLabels;
+	size_t windowCount = 0;
+
+	std::mt19937_64 gen;
+
+	bool openNextShard() {
+		if (nextShard == shardOrder.size()) {
+			imageReader.reset();
+			labelReader.reset();
+			return false;
+		}
+
+		const Shard& shard = shards[shardOrder[nextShard++]];
+		imageReader.reset(new IdxReader(imageFiles[shard.file]));
+		labelReader.reset(new IdxReader(labelFiles[shard.file]));
+		if (shard.begin > 0) {
+			imageReader->seekToItem(shard.begin);
+			labelReader->seekToItem(shard.begin);
+		}
+		shardRemaining = shard.end - shard.begin;
+		currentScale = fileScale[shard.file];
+		return true;
+	}
+
+	bool readSample(float* dst, int& label) {
+		const size_t sampleSize = rows * cols;
+		const size_t chunkItems = 256;
+
+		if (chunkPos == chunkCount) {
+			while (shardRemaining == 0) {
+				if (!openNextShard()) {
+					return false;
+				}
+			}
+
+			size_t count = std::min(chunkItems, shardRemaining);
+			chunkData.resize(count * sampleSize);
+			chunkLabels.resize(count);
+			imageReader->readItems(chunkData.data(), count);
+			labelReader->readItems(chunkLabels.data(), count);
+			for (auto& val : chunkData) {
+				val = static_cast<float>(val * currentScale);
+			}
+
+			shardRemaining -= count;
+			chunkPos = 0;
+			chunkCount = count;
+		}
+
+		std::copy(&chunkData[chunkPos * sampleSize], &chunkData[chunkPos * sampleSize] + sampleSize, dst);
+		label = chunkLabels[chunkPos];
+		chunkPos++;
+		return true;
+	}
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdexcept>
+
+// Fixed set of worker threads running submitted tasks in FIFO order. Tasks must not throw.
+// The destructor runs every task still queued before joining the workers.
+class ThreadPool {
+public:
+	explicit ThreadPool(size_t threads) {
+		if (threads == 0) {
+			throw std::invalid_argument("A thread pool needs at least one thread.");
+		}
+		for (size_t i = 0; i < threads; i++) {
+			workers.emplace_back([this] { workerLoop(); });
+		}
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void submit(std::function<void()> task) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.push_back(std::move(task));
+		}
+		wake.notify_one();
+	}
+
+	size_t size() const noexcept {
+		return workers.size();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<std::function<void()>> tasks;
+	bool stopping = false;
+	std::vector<std::thread> workers;
+
+	void workerLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			wake.wait(lock, [this] { return !tasks.empty() || stopping; });
+			if (tasks.empty()) {
+				return;
+			}
+			std::function<void()> task = std::move(tasks.front());
+			tasks.pop_front();
+			lock.unlock();
+			task();
+			lock.lock();
+		}
+	}
+};
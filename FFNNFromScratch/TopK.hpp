@@ -0,0 +1,169 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+struct TopKEntry {
+	int label;
+	float probability;
+};
+
+// index of the largest of n values, the lowest index on ties
+template <typename T>
+inline int argmax(const T* values, size_t n) {
+	size_t best = 0;
+	for (size_t i = 1; i < n; i++) {
+		best = values[i] > values[best] ? i : best;
+	}
+	return static_cast<int>(best);
+}
+
+namespace topk {
+	// k largest of one sample's outputs into result[0, k), largest first and the lower label on ties,
+	// by insertion so each value costs at most k compares
+	inline void insertSorted(const float* outputs, size_t numClasses, size_t k, TopKEntry* result) {
+		size_t filled = 0;
+		for (size_t c = 0; c < numClasses; c++) {
+			TopKEntry entry{ static_cast<int>(c), outputs[c] };
+			for (size_t j = 0; j < filled && j < k; j++) {
+				// a value pushed down from an earlier slot still goes ahead of an equal one with a higher label
+				if (entry.probability > result[j].probability || (entry.probability == result[j].probability && entry.label < result[j].label)) {
+					std::swap(entry, result[j]);
+				}
+			}
+			if (filled < k) {
+				result[filled++] = entry;
+			}
+		}
+	}
+
+	inline float probabilityScale(const float* outputs, size_t numClasses) {
+		float sum = 0.0f;
+		for (size_t c = 0; c < numClasses; c++) {
+			sum += outputs[c];
+		}
+		return sum > 0.0f ? 1.0f / sum : 0.0f;
+	}
+
+	// the SIMD path keeps k running (value, label) pairs per lane in registers
+	constexpr size_t maxSimdK = 16;
+}
+
+// Top k of every sample in a batch of outputs stored sample after sample (count x numClasses):
+// result[s * k + j] is sample s's j-th largest output, largest first and the lower label on ties,
+// divided by the sum of the sample's outputs so it reads as a probability. k must not exceed
+// numClasses. Under AVX2 eight samples go through together, one gather per class and a
+// compare-and-blend insertion into k sorted registers, so there is no branch per value.
+inline void topKBatch(const float* outputs, size_t numClasses, size_t count, size_t k, TopKEntry* result) {
+	if (k == 0) {
+		return;
+	}
+	size_t s = 0;
+
+#ifdef __AVX2__
+	if (k <= topk::maxSimdK) {
+		const __m256i lanes = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int>(numClasses)));
+		const __m256 empty = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		__m256 values[topk::maxSimdK];
+		__m256 labels[topk::maxSimdK]; // label bits as floats so the same blend moves them, all ones marks an empty slot
+		alignas(32) float laneValues[8];
+		alignas(32) int laneLabels[8];
+		alignas(32) float laneScales[8];
+
+		for (; s + 8 <= count; s += 8) {
+			const float* base = outputs + s * numClasses;
+			for (size_t j = 0; j < k; j++) {
+				values[j] = _mm256_setzero_ps();
+				labels[j] = empty;
+			}
+			__m256 sum = _mm256_setzero_ps();
+			for (size_t c = 0; c < numClasses; c++) {
+				__m256 value = _mm256_i32gather_ps(base + c, lanes, 4);
+				__m256 label = _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(c)));
+				sum = _mm256_add_ps(sum, value);
+				for (size_t j = 0; j < k; j++) {
+					// take slot j where the value beats it, ties it with a lower label or it is still empty; what was there moves down
+					__m256i slotLabel = _mm256_castps_si256(labels[j]);
+					__m256 unused = _mm256_castsi256_ps(_mm256_cmpeq_epi32(slotLabel, _mm256_castps_si256(empty)));
+					__m256 lowerLabel = _mm256_castsi256_ps(_mm256_cmpgt_epi32(slotLabel, _mm256_castps_si256(label)));
+					__m256 tie = _mm256_and_ps(_mm256_cmp_ps(value, values[j], _CMP_EQ_OQ), lowerLabel);
+					__m256 take = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(value, values[j], _CMP_GT_OQ), tie), unused);
+					__m256 displacedValue = _mm256_blendv_ps(value, values[j], take);
+					__m256 displacedLabel = _mm256_blendv_ps(label, labels[j], take);
+					values[j] = _mm256_blendv_ps(values[j], value, take);
+					labels[j] = _mm256_blendv_ps(labels[j], label, take);
+					value = displacedValue;
+					label = displacedLabel;
+				}
+			}
+
+			// same scale as the scalar path, the lane sums add the classes in the same order
+			__m256 positive = _mm256_cmp_ps(sum, _mm256_setzero_ps(), _CMP_GT_OQ);
+			_mm256_store_ps(laneScales, _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(1.0f), sum), positive));
+			for (size_t j = 0; j < k; j++) {
+				_mm256_store_ps(laneValues, values[j]);
+				_mm256_store_si256(reinterpret_cast<__m256i*>(laneLabels), _mm256_castps_si256(labels[j]));
+				for (size_t l = 0; l < 8; l++) {
+					result[(s + l) * k + j] = { laneLabels[l], laneValues[l] * laneScales[l] };
+				}
+			}
+		}
+	}
+#endif
+
+	for (; s < count; s++) {
+		const float* sample = outputs + s * numClasses;
+		TopKEntry* best = result + s * k;
+		topk::insertSorted(sample, numClasses, k, best);
+		const float scale = topk::probabilityScale(sample, numClasses);
+		for (size_t j = 0; j < k; j++) {
+			best[j].probability *= scale;
+		}
+	}
+}
+
+// the k largest outputs of one sample, largest first, each divided by the sum of all outputs so they read as probabilities
+inline void topK(std::span<const float> outputs, size_t k, std::vector<TopKEntry>& result) {
+	k = std::min(k, outputs.size());
+	result.resize(k);
+	topKBatch(outputs.data(), outputs.size(), 1, k, result.data());
+}
+
+// Index and value of the largest output of every sample in a (count x numClasses) batch, the lower
+// index on ties; scores may be null. Eight samples per pass under AVX2, like topKBatch.
+inline void argmaxBatch(const float* outputs, size_t numClasses, size_t count, int* indices, float* scores = nullptr) {
+	size_t s = 0;
+
+#ifdef __AVX2__
+	if (numClasses > 0) {
+		const __m256i lanes = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int>(numClasses)));
+		for (; s + 8 <= count; s += 8) {
+			const float* base = outputs + s * numClasses;
+			__m256 best = _mm256_i32gather_ps(base, lanes, 4);
+			__m256i bestIndex = _mm256_setzero_si256();
+			for (size_t c = 1; c < numClasses; c++) {
+				__m256 value = _mm256_i32gather_ps(base + c, lanes, 4);
+				__m256 greater = _mm256_cmp_ps(value, best, _CMP_GT_OQ);
+				best = _mm256_blendv_ps(best, value, greater);
+				bestIndex = _mm256_blendv_epi8(bestIndex, _mm256_set1_epi32(static_cast<int>(c)), _mm256_castps_si256(greater));
+			}
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(indices + s), bestIndex);
+			if (scores) {
+				_mm256_storeu_ps(scores + s, best);
+			}
+		}
+	}
+#endif
+
+	for (; s < count; s++) {
+		const float* sample = outputs + s * numClasses;
+		indices[s] = argmax(sample, numClasses);
+		if (scores) {
+			scores[s] = sample[indices[s]];
+		}
+	}
+}
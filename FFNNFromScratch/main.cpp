@@ -9,22 +9,20 @@
 
 int main() {
     try {
-        //MNISTLoader trainLoader("Data/train-images.idx3-ubyte", "Data/train-labels.idx1-ubyte");
-        //MNISTLoader testLoader("Data/t10k-images.idx3-ubyte", "Data/t10k-labels.idx1-ubyte");
+        //MNISTLoader trainLoader("Data/train-images-idx3-ubyte.gz", "Data/train-labels-idx1-ubyte.gz");
+        //MNISTLoader testLoader("Data/t10k-images-idx3-ubyte.gz", "Data/t10k-labels-idx1-ubyte.gz");
 
         //// retrieve images as matrix objects
-        //std::vector<Matrix> mnistTrain = trainLoader.getImages();
-        //std::vector<int> labelsTrain = trainLoader.getLabels();
+        //const std::vector<Matrix>& mnistTrain = trainLoader.getImages();
+        //const std::vector<int>& labelsTrain = trainLoader.getLabels();
 
-        //std::vector<Matrix> mnistTest = testLoader.getImages();
-        //std::vector<int> labelsTest = testLoader.getLabels();
-
-        FFNN model({ 784, 128, 64, 10 }); // 28 * 28 img size = 784 1-D array
+        //const std::vector<Matrix>& mnistTest = testLoader.getImages();
+        //const std::vector<int>& labelsTest = testLoader.getLabels();
 
         std::string loadPath = "Models/ffnn_model.dat";
-        
-        // load file into new FFNN object and test loaded model
-        loadModel(model.getLayers(), loadPath);
+
+        // build the network straight from the model file, e.g. { 784, 128, 64, 10 } for 28 * 28 images
+        FFNN model = FFNN::fromFile(loadPath);
 
         // TODO: get the input image from the user, with an SFML drawing app that allows digits to be manually drawn
         // get the digits, normalize the values, and resize the vector into a 28 * 28 and then flatten and forward pass
@@ -0,0 +1,94 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <memory>
+#include "Utils.hpp"
+#include "Serialize.hpp"
+#include "BatchPredictor.hpp"
+
+// FFNNPredict <model file> <samples> [options]
+// streams an IDX or raw uint8 sample file through the model and writes every prediction
+int usage() {
+    std::cerr << "Usage: FFNNPredict <model file> <samples> [options]\n"
+        << "  --raw             samples (and labels) are raw uint8 records instead of IDX\n"
+        << "  --labels <file>   report accuracy against these labels\n"
+        << "  --out <file>      write predictions, CSV when the name ends in .csv, binary otherwise\n"
+        << "  --threads <n>     inference threads (default: all cores)\n"
+        << "  --chunk <n>       samples read per chunk (default 4096)" << std::endl;
+    return 2;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        return usage();
+    }
+
+    try {
+        std::string modelPath = argv[1];
+        std::string samplesPath = argv[2];
+        std::string labelsPath;
+        std::string outputPath;
+        bool raw = false;
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        size_t chunk = 4096;
+
+        for (int i = 3; i < argc; i++) {
+            std::string option = argv[i];
+            if (option == "--raw") {
+                raw = true;
+            }
+            else if (i + 1 < argc && option == "--labels") {
+                labelsPath = argv[++i];
+            }
+            else if (i + 1 < argc && option == "--out") {
+                outputPath = argv[++i];
+            }
+            else if (i + 1 < argc && option == "--threads") {
+                threads = std::stoul(argv[++i]);
+            }
+            else if (i + 1 < argc && option == "--chunk") {
+                chunk = std::stoul(argv[++i]);
+            }
+            else {
+                return usage();
+            }
+        }
+
+        auto model = std::make_shared<const CompiledModel>(readModel(modelPath));
+        SampleReader samples(samplesPath, raw, model->numInputs());
+        std::unique_ptr<LabelReader> labels;
+        if (!labelsPath.empty()) {
+            labels = std::make_unique<LabelReader>(labelsPath, raw);
+        }
+
+        std::ofstream output;
+        PredictionFormat format = PredictionFormat::none;
+        if (!outputPath.empty()) {
+            bool csv = outputPath.size() >= 4 && outputPath.compare(outputPath.size() - 4, 4, ".csv") == 0;
+            format = csv ? PredictionFormat::csv : PredictionFormat::binary;
+            output.open(outputPath, csv ? std::ios::out : std::ios::out | std::ios::binary);
+            if (!output.is_open()) {
+                throw std::runtime_error("Unable to open file for writing: " + outputPath);
+            }
+        }
+
+        BatchPredictor predictor(model, threads, chunk);
+        PredictionSummary summary = predictor.run(samples, labels.get(), output.is_open() ? &output : nullptr, format);
+        if (output.is_open() && !output) {
+            throw std::runtime_error("Failed writing " + outputPath);
+        }
+
+        std::cout << summary.samples << " samples in " << summary.seconds << " s: " << summary.imagesPerSecond() << " images/s on "
+            << threads << " threads" << std::endl;
+        if (summary.labelled > 0) {
+            std::cout << "Accuracy: " << summary.accuracy() << "% (" << summary.correct << "/" << summary.labelled << ")" << std::endl;
+        }
+    }
+    catch (const std::exception& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
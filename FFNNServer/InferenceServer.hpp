@@ -0,0 +1,304 @@
+#pragma once
+#include <SFML/Network.hpp>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <filesystem>
+#include <stdexcept>
+#include "MultiModelBatcher.hpp"
+
+// Wire format, one sf::Packet per message in both directions:
+//   request   Uint32 id, Uint32 model, Uint32 k, then the model's numInputs raw Uint8 pixels (0-255, row-major)
+//   response  Uint32 id, Uint32 status, Uint32 count, then count x (Uint32 label, float probability)
+// model is the index the model was added under, 0 for the first. Responses to a connection's
+// requests can come back in a different order than they were sent, the id ties them together.
+// status is one of the ResponseStatus values.
+enum class ResponseStatus : sf::Uint32 {
+	ok = 0,
+	badRequest = 1, // wrong pixel count or malformed packet, count is 0
+	unknownModel = 2 // no model with that index, count is 0
+};
+
+// Headless classification server: one thread multiplexes the listener and all client sockets with
+// an sf::SocketSelector and hands every request to a MultiModelBatcher, which runs the batches of
+// every hosted model on one shared pool. Client sockets are non-blocking, so no client can hold up
+// the others: a packet that has only partly arrived stays in its socket until the rest comes, and
+// responses queue per connection. Pool threads send what the socket takes at once, the I/O thread
+// flushes the rest. A client that stops reading for sendTimeout, or lets maxQueuedResponses pile
+// up, is dropped.
+class InferenceServer {
+public:
+	// no models yet, addModel() them before run()
+	InferenceServer(unsigned short port, size_t threads) : batcher(threads) {
+		if (listener.listen(port) != sf::Socket::Done) {
+			throw std::runtime_error("Unable to listen on port " + std::to_string(port));
+		}
+		selector.add(listener);
+	}
+
+	// a single model with the whole pool of options.workers threads
+	InferenceServer(std::shared_ptr<ModelRegistry> registry, unsigned short port, const BatchingOptions& options) :
+		InferenceServer(port, options.workers)
+	{
+		const std::string name = registry->read()->source;
+		addModel(name.empty() ? "model" : name, std::move(registry), ModelQuota{}, options);
+	}
+
+	// returns the index clients select the model with; cacheBytes > 0 answers repeated images from a prediction cache
+	size_t addModel(const std::string& name, std::shared_ptr<ModelRegistry> registry, const ModelQuota& quota, const BatchingOptions& options, size_t cacheBytes = 0) {
+		const size_t index = batcher.addModel(name, std::move(registry), quota, options, cacheBytes);
+		reported.push_back(batcher.getCounters(index));
+		return index;
+	}
+
+	// serves until stop() is called from another thread
+	void run() {
+		running = true;
+		auto lastReport = std::chrono::steady_clock::now();
+		while (running) {
+			const auto now = std::chrono::steady_clock::now();
+			if (metricsInterval.count() > 0 && now - lastReport >= metricsInterval) {
+				printMetrics(std::chrono::duration<double>(now - lastReport).count());
+				lastReport = now;
+			}
+			if (!watched.empty() && now - lastWatch >= std::chrono::seconds(1)) {
+				for (WatchedFile& file : watched) {
+					reloadIfChanged(file);
+				}
+				lastWatch = now;
+			}
+
+			// the timeout bounds how long stop() takes to be noticed, or how often queued responses are retried
+			const bool ready = selector.wait(sf::milliseconds(backlog ? 1 : 100));
+			if (ready && selector.isReady(listener)) {
+				accept();
+			}
+			backlog = false;
+			for (size_t i = 0; i < connections.size();) {
+				Connection& connection = *connections[i];
+				bool open = !(ready && selector.isReady(connection.socket)) || receive(connections[i]);
+				if (open) {
+					std::lock_guard<std::mutex> lock(connection.sendMutex);
+					if (!connection.dropped && !flush(connection)) {
+						connection.dropped = true;
+					}
+					open = !connection.dropped;
+					backlog = backlog || !connection.outbox.empty();
+				}
+
+				if (!open) {
+					close(connection);
+					connections[i] = connections.back();
+					connections.pop_back();
+				}
+				else {
+					i++;
+				}
+			}
+		}
+	}
+
+	void stop() noexcept {
+		running = false;
+	}
+
+	size_t numConnections() const noexcept {
+		return connections.size();
+	}
+
+	size_t numModels() const {
+		return batcher.numModels();
+	}
+
+	ModelCounters getCounters(size_t model) const {
+		return batcher.getCounters(model);
+	}
+
+	// reload a model whenever this file changes, e.g. when training writes a new checkpoint. The
+	// swap is atomic: requests already computing finish on the old weights.
+	void watchModelFile(size_t model, const std::string& filename) {
+		batcher.getRegistry(model); // throws for an unknown index
+		watched.push_back({ model, filename, std::filesystem::last_write_time(filename) });
+	}
+
+	// print every model's counters to stdout this often while serving, 0 turns it off
+	void setMetricsInterval(std::chrono::seconds interval) noexcept {
+		metricsInterval = interval;
+	}
+
+private:
+	// shared with the callbacks of its in-flight requests, so a client may disconnect before they finish
+	struct Connection {
+		sf::TcpSocket socket;
+		std::mutex sendMutex; // several pool threads may answer the same client, guards the fields below
+		std::deque<sf::Packet> outbox; // responses the socket has not taken yet, the front one may be partly sent
+		std::chrono::steady_clock::time_point lastProgress; // when the outbox last shrank or stopped being empty
+		bool dropped = false; // too slow or gone, the I/O thread closes it
+	};
+
+	static constexpr size_t maxQueuedResponses = 1024;
+	static constexpr std::chrono::seconds sendTimeout{ 5 };
+
+	struct WatchedFile {
+		size_t model;
+		std::string filename;
+		std::filesystem::file_time_type lastWriteTime;
+	};
+
+	MultiModelBatcher batcher;
+	sf::TcpListener listener;
+	sf::SocketSelector selector;
+	std::vector<std::shared_ptr<Connection>> connections;
+	std::atomic<bool> running{ false };
+	std::vector<float> pixels; // request scratch, only touched by the I/O thread
+	std::chrono::seconds metricsInterval{ 0 };
+	std::vector<ModelCounters> reported; // per model, as of the last report
+	std::vector<WatchedFile> watched;
+	std::chrono::steady_clock::time_point lastWatch;
+	bool backlog = false; // some connection has queued responses
+
+	// checked from the I/O thread about once a second, loading a model takes a few milliseconds
+	void reloadIfChanged(WatchedFile& file) {
+		std::error_code error;
+		auto writeTime = std::filesystem::last_write_time(file.filename, error);
+		if (error || writeTime == file.lastWriteTime) {
+			return;
+		}
+		file.lastWriteTime = writeTime;
+		try {
+			uint64_t version = batcher.getRegistry(file.model).load(file.filename);
+			std::cout << "Loaded " << file.filename << " as version " << version << " of model " << file.model << std::endl;
+		}
+		catch (const std::exception& ex) {
+			std::cerr << "Keeping the current model " << file.model << ", " << file.filename << " could not be loaded: " << ex.what() << std::endl;
+		}
+	}
+
+	// throughput, mean latency and pool share are over the interval since the previous report
+	void printMetrics(double seconds) {
+		for (size_t i = 0; i < reported.size(); i++) {
+			ModelCounters c = batcher.getCounters(i);
+			const ModelCounters& last = reported[i];
+			// latency covers computed requests, the rate also those answered from the cache
+			const uint64_t answered = c.batching.requests - last.batching.requests;
+			const uint64_t hits = c.cache.hits - last.cache.hits;
+			std::cout << "model " << i << " (" << batcher.getName(i) << " v" << c.version << "): " << (answered + hits) / seconds << " req/s, mean latency "
+				<< (answered > 0 ? (c.latencyMicros - last.latencyMicros) / answered : 0.0) << " us, p99 " << c.batching.p99Micros
+				<< " us, pool time " << (c.computeMicros - last.computeMicros) / (10000.0 * seconds) << "%, mean batch " << c.batching.meanBatch
+				<< ", batch limit " << c.batching.batchLimit << ", window " << c.batching.window.count() << " us, queued " << c.queued;
+			if (c.cache.capacity > 0) {
+				const uint64_t lookups = hits + c.cache.misses - last.cache.misses;
+				std::cout << ", cache hits " << (lookups > 0 ? 100.0 * hits / lookups : 0.0) << "% (" << c.cache.entries
+					<< " entries, " << c.cache.bytes / 1024 << " KiB)";
+			}
+			std::cout << std::endl;
+			reported[i] = c;
+		}
+	}
+
+	void accept() {
+		auto connection = std::make_shared<Connection>();
+		if (listener.accept(connection->socket) == sf::Socket::Done) {
+			connection->socket.setBlocking(false);
+			selector.add(connection->socket);
+			connections.push_back(std::move(connection));
+		}
+	}
+
+	void close(Connection& connection) {
+		{
+			std::lock_guard<std::mutex> lock(connection.sendMutex);
+			connection.dropped = true; // callbacks still in flight drop their responses
+			connection.outbox.clear();
+		}
+		selector.remove(connection.socket);
+		connection.socket.disconnect();
+	}
+
+	// false once the client is gone. Reads at most one packet, NotReady means only part of it is here.
+	bool receive(const std::shared_ptr<Connection>& connection) {
+		sf::Packet packet;
+		sf::Socket::Status status = connection->socket.receive(packet);
+		if (status == sf::Socket::Disconnected || status == sf::Socket::Error) {
+			return false;
+		}
+		if (status != sf::Socket::Done) {
+			return true;
+		}
+
+		sf::Uint32 id = 0;
+		sf::Uint32 model = 0;
+		sf::Uint32 k = 0;
+		const size_t header = 3 * sizeof(sf::Uint32);
+		if (!(packet >> id >> model >> k)) {
+			respond(connection, id, ResponseStatus::badRequest, {});
+			return true;
+		}
+		if (model >= reported.size()) {
+			respond(connection, id, ResponseStatus::unknownModel, {});
+			return true;
+		}
+		pixels.resize(batcher.getRegistry(model).getNumInputs());
+		if (packet.getDataSize() != header + pixels.size()) {
+			respond(connection, id, ResponseStatus::badRequest, {});
+			return true;
+		}
+
+		const sf::Uint8* raw = static_cast<const sf::Uint8*>(packet.getData()) + header;
+		for (size_t i = 0; i < pixels.size(); i++) {
+			pixels[i] = raw[i] / 255.0f; // same scale as MNISTLoader
+		}
+		batcher.submit(model, pixels, k, [connection, id](std::span<const TopKEntry> best) {
+			respond(connection, id, ResponseStatus::ok, best);
+		});
+		return true;
+	}
+
+	static void respond(const std::shared_ptr<Connection>& connection, sf::Uint32 id, ResponseStatus status, std::span<const TopKEntry> best) {
+		sf::Packet packet;
+		packet << id << static_cast<sf::Uint32>(status) << static_cast<sf::Uint32>(best.size());
+		for (const TopKEntry& entry : best) {
+			packet << static_cast<sf::Uint32>(entry.label) << entry.probability;
+		}
+		std::lock_guard<std::mutex> lock(connection->sendMutex);
+		if (connection->dropped) {
+			return;
+		}
+		if (connection->outbox.empty()) {
+			connection->lastProgress = std::chrono::steady_clock::now();
+		}
+		connection->outbox.push_back(std::move(packet));
+		if (!flush(*connection)) {
+			connection->dropped = true;
+		}
+	}
+
+	// sends queued responses until the socket would block; false when the client is gone or too slow.
+	// Called with sendMutex held.
+	static bool flush(Connection& connection) {
+		const auto now = std::chrono::steady_clock::now();
+		while (!connection.outbox.empty()) {
+			sf::Socket::Status status = connection.socket.send(connection.outbox.front());
+			if (status == sf::Socket::Done) {
+				connection.outbox.pop_front();
+				connection.lastProgress = now;
+			}
+			else if (status == sf::Socket::Partial) {
+				connection.lastProgress = now; // the packet remembers how far it got, send it again later
+				break;
+			}
+			else if (status == sf::Socket::NotReady) {
+				break;
+			}
+			else {
+				return false;
+			}
+		}
+		return connection.outbox.empty() || (connection.outbox.size() <= maxQueuedResponses && now - connection.lastProgress < sendTimeout);
+	}
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <SFML/Network.hpp>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+
+struct LoadTestResult {
+	size_t requests = 0;
+	size_t correct = 0; // top-1 label matched
+	double seconds = 0.0;
+	double p50Micros = 0.0;
+	double p99Micros = 0.0;
+};
+
+// Closed-loop load against a running InferenceServer: each of `connections` threads keeps `depth`
+// requests in flight on its own socket until it has had `requestsPerConnection` answers. Connection i
+// asks model i % models. Images are 0-255 pixels, numInputs per image, sent round robin; labels
+// score the top-1 answers.
+inline LoadTestResult runLoadTest(const std::string& host, unsigned short port, const std::vector<uint8_t>& images, const std::vector<int>& labels,
+	size_t connections, size_t requestsPerConnection, size_t depth, size_t models = 1)
+{
+	const size_t numImages = labels.size();
+	const size_t imageSize = numImages > 0 ? images.size() / numImages : 0;
+	if (numImages == 0 || imageSize * numImages != images.size()) {
+		throw std::invalid_argument("Load test needs images and labels of matching counts.");
+	}
+	if (models == 0) {
+		throw std::invalid_argument("Load test needs at least one model to ask.");
+	}
+
+	std::mutex resultMutex;
+	std::vector<double> latencies;
+	std::atomic<size_t> correct{ 0 };
+	std::atomic<bool> failed{ false };
+
+	auto client = [&](size_t index) {
+		sf::TcpSocket socket;
+		if (socket.connect(sf::IpAddress(host), port) != sf::Socket::Done) {
+			failed = true;
+			return;
+		}
+
+		// request id = position in this client's sequence, so it indexes both the image and the send time
+		std::vector<std::chrono::steady_clock::time_point> sent(requestsPerConnection);
+		std::vector<double> local;
+		local.reserve(requestsPerConnection);
+		size_t next = 0;
+
+		auto send = [&]() {
+			const size_t image = (index * requestsPerConnection + next) % numImages;
+			sf::Packet packet;
+			packet << static_cast<sf::Uint32>(next) << static_cast<sf::Uint32>(index % models) << static_cast<sf::Uint32>(1);
+			packet.append(images.data() + image * imageSize, imageSize);
+			sent[next] = std::chrono::steady_clock::now();
+			next++;
+			return socket.send(packet) == sf::Socket::Done;
+		};
+
+		for (size_t i = 0; i < depth && next < requestsPerConnection; i++) {
+			if (!send()) {
+				failed = true;
+				return;
+			}
+		}
+		while (local.size() < requestsPerConnection) {
+			sf::Packet packet;
+			sf::Uint32 id, status, count, label = 0;
+			float probability = 0.0f;
+			if (socket.receive(packet) != sf::Socket::Done || !(packet >> id >> status >> count) || id >= requestsPerConnection) {
+				failed = true;
+				return;
+			}
+			local.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent[id]).count());
+			if (count > 0 && (packet >> label >> probability) && static_cast<int>(label) == labels[(index * requestsPerConnection + id) % numImages]) {
+				correct++;
+			}
+			if (next < requestsPerConnection && !send()) {
+				failed = true;
+				return;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(resultMutex);
+		latencies.insert(latencies.end(), local.begin(), local.end());
+	};
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < connections; i++) {
+		threads.emplace_back(client, i);
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	if (failed) {
+		throw std::runtime_error("Load test lost its connection to " + host + ":" + std::to_string(port));
+	}
+
+	LoadTestResult result;
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.requests = latencies.size();
+	result.correct = correct;
+	std::sort(latencies.begin(), latencies.end());
+	if (!latencies.empty()) {
+		result.p50Micros = latencies[latencies.size() / 2];
+		result.p99Micros = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+	}
+	return result;
+}
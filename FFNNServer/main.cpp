@@ -0,0 +1,124 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <cmath>
+#include "Utils.hpp"
+#include "FFNN.hpp"
+#include "MNISTLoader.hpp"
+#include "InferenceServer.hpp"
+#include "LoadClient.hpp"
+
+// FFNNServer serve <model[,model...]> [port] [max batch] [max wait us] [threads] [p99 target us] [cache MiB per model]
+// FFNNServer bench <host> <port> <images> <labels> [connections] [requests per connection] [depth] [models]
+// where a model is <file>[@weight[/max concurrent batches]], clients select it by its position in the list
+int usage() {
+    std::cerr << "Usage:\n"
+        << "  FFNNServer serve <model[,model...]> [port=5000] [max batch=32] [max wait us=500] [threads=1] [p99 target us=0 (fixed batching)] [cache MiB=0]\n"
+        << "  FFNNServer bench <host> <port> <images> <labels> [connections=4] [requests=10000] [depth=16] [models=1]\n"
+        << "  model = <file>[@weight=1[/max concurrent batches=threads]]" << std::endl;
+    return 2;
+}
+
+struct ModelSpec {
+    std::string file;
+    ModelQuota quota;
+};
+
+// "a.dat,b.dat@2,c.dat@1/1"
+std::vector<ModelSpec> parseModels(const std::string& list) {
+    std::vector<ModelSpec> specs;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = std::min(list.find(',', start), list.size());
+        std::string item = list.substr(start, end - start);
+        ModelSpec spec;
+        size_t at = item.rfind('@');
+        spec.file = item.substr(0, at);
+        if (at != std::string::npos) {
+            std::string quota = item.substr(at + 1);
+            size_t slash = quota.find('/');
+            spec.quota.weight = std::stod(quota.substr(0, slash));
+            if (slash != std::string::npos) {
+                spec.quota.maxConcurrency = std::stoul(quota.substr(slash + 1));
+            }
+        }
+        if (spec.file.empty()) {
+            throw std::invalid_argument("Empty model file in " + list);
+        }
+        specs.push_back(spec);
+        start = end + 1;
+    }
+    return specs;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        return usage();
+    }
+
+    try {
+        std::string mode = argv[1];
+        auto arg = [&](int index, size_t fallback) {
+            return index < argc ? static_cast<size_t>(std::stoul(argv[index])) : fallback;
+        };
+
+        if (mode == "serve") {
+            std::vector<ModelSpec> specs = parseModels(argv[2]);
+            unsigned short port = static_cast<unsigned short>(arg(3, 5000));
+
+            BatchingOptions options;
+            options.maxBatch = arg(4, 32);
+            options.maxWait = std::chrono::microseconds(arg(5, 500));
+            options.workers = arg(6, 1);
+            options.latencyTarget = std::chrono::microseconds(arg(7, 0));
+            size_t cacheBytes = arg(8, 0) << 20;
+
+            InferenceServer server(port, options.workers);
+            server.setMetricsInterval(std::chrono::seconds(5));
+            std::cout << "Serving on port " << port << " with " << options.workers << " threads (max batch " << options.maxBatch
+                << ", max wait " << options.maxWait.count() << " us";
+            if (options.latencyTarget.count() > 0) {
+                std::cout << ", p99 target " << options.latencyTarget.count() << " us";
+            }
+            if (cacheBytes > 0) {
+                std::cout << ", " << (cacheBytes >> 20) << " MiB prediction cache per model";
+            }
+            std::cout << ")" << std::endl;
+
+            // each model is loaded and compiled once, its requests share the same plan until the file changes
+            for (const ModelSpec& spec : specs) {
+                size_t index = server.addModel(std::filesystem::path(spec.file).stem().string(), ModelRegistry::fromFile(spec.file), spec.quota, options, cacheBytes);
+                server.watchModelFile(index, spec.file);
+                std::cout << "  model " << index << ": " << spec.file << ", weight " << spec.quota.weight << ", max concurrent batches "
+                    << (spec.quota.maxConcurrency == 0 ? options.workers : spec.quota.maxConcurrency) << std::endl;
+            }
+            server.run();
+        }
+        else if (mode == "bench" && argc >= 6) {
+            MNISTLoader loader(argv[4], argv[5]);
+            const std::vector<Matrix>& images = loader.getImages();
+            const size_t imageSize = images.front().numRows() * images.front().numCols();
+            std::vector<uint8_t> pixels(images.size() * imageSize);
+            for (size_t i = 0; i < images.size(); i++) {
+                for (size_t p = 0; p < imageSize; p++) {
+                    pixels[i * imageSize + p] = static_cast<uint8_t>(std::lround(images[i].data()[p] * 255.0));
+                }
+            }
+
+            size_t connections = arg(6, 4);
+            LoadTestResult result = runLoadTest(argv[2], static_cast<unsigned short>(arg(3, 5000)), pixels, loader.getLabels(), connections, arg(7, 10000), arg(8, 16), arg(9, 1));
+            std::cout << result.requests << " requests in " << result.seconds << " s: " << result.requests / result.seconds << " req/s, p50 "
+                << result.p50Micros << " us, p99 " << result.p99Micros << " us, top-1 accuracy " << 100.0 * result.correct / result.requests << "%" << std::endl;
+        }
+        else {
+            return usage();
+        }
+    }
+    catch (const std::exception& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}